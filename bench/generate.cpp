@@ -0,0 +1,88 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "generator.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: brief-generate [--tasks <count>] [--exports <count>] [--dependencies <average count>]\n"
+    "                      [--flavors <count>] [--optionals <count>] [--sources <count per task>] [--seed <seed>]\n"
+    "                      [--write-sources] <output directory>\n"
+    "Writes a synthetic repository description, synthetic.brief, and with --write-sources its sources.\n";
+
+}  // namespace
+
+int main(int _argc, char **_argv) {
+  brief::generator_options_t options;
+  bool sources = false;
+  fs::path output;
+  for (int i = 1; i < _argc; i++) {
+    const std::string arg = _argv[i];
+    const bool hasValue = i + 1 < _argc;
+    if (arg == "--tasks" && hasValue) {
+      options.tasks_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--exports" && hasValue) {
+      options.exports_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--dependencies" && hasValue) {
+      options.dependencies_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--flavors" && hasValue) {
+      options.flavors_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--optionals" && hasValue) {
+      options.optionals_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--sources" && hasValue) {
+      options.sources_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--seed" && hasValue) {
+      options.seed_ = static_cast<uint32_t>(std::strtoul(_argv[++i], nullptr, 10));
+    } else if (arg == "--write-sources") {
+      sources = true;
+    } else if (output.empty() && arg[0] != '-') {
+      output = arg;
+    } else {
+      std::cerr << USAGE;
+      return 1;
+    }
+  }
+  if (output.empty()) {
+    std::cerr << USAGE;
+    return 1;
+  }
+
+  try {
+    const brief::Repository repo = brief::generate(options);
+    fs::create_directories(output);
+    std::ofstream description((output / "synthetic.brief").string());
+    brief::json<brief::Repository>::serialize(description, repo);
+    description.close();
+    if (sources)
+      brief::writeSources(repo, options, output);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
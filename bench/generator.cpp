@@ -0,0 +1,160 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "generator.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::string taskName(size_t _index) {
+  return "lib" + std::to_string(_index);
+}
+
+std::string flavorName(size_t _index) {
+  return _index == 0 ? "debug" : _index == 1 ? "release" : "flavor" + std::to_string(_index);
+}
+
+/** Picks a dependency among the *_count* previous tasks, the lower ones being picked much more often. */
+size_t pickDependency(std::mt19937 &_random, size_t _count) {
+  const double skew = std::uniform_real_distribution<double>(0, 1)(_random);
+  return std::min(_count - 1, static_cast<size_t>(_count * skew * skew * skew));
+}
+
+}  // namespace
+
+Repository generate(const generator_options_t &_options) {
+  std::mt19937 random(_options.seed_);
+  Repository repo;
+  repo.name_ = "synthetic";
+  repo.url_ = "https://example.com/synthetic.git";
+  repo.constants_.emplace("CXX_STANDARD", "c++14");
+
+  // Applications are the last tenth of the tasks and depend on more tasks than libraries
+  const size_t applications = _options.tasks_ / 10;
+  std::geometric_distribution<size_t> libraryFanOut(1.0 / (1 + _options.dependencies_));
+  std::geometric_distribution<size_t> applicationFanOut(1.0 / (1 + 4 * _options.dependencies_));
+
+  for (size_t i = 0; i < _options.tasks_; i++) {
+    const std::string name = taskName(i);
+    const bool application = i >= _options.tasks_ - applications && i > 0;
+    Task task;
+    task.type_ = application ? Task::type_t::APPLICATION : Task::type_t::LIBRARY;
+    task.toolchain_ = "clang";
+    task.standard_ = "${CXX_STANDARD}";
+    task.sources_ = {name + "/src/*.cpp"};
+    if (!application) {
+      task.includeDirs_ = {name + "/inc"};
+      task.headers_ = {name + "/inc/" + name + ".h"};
+    }
+    task.symbols_.emplace("SYNTHETIC_TASK", std::to_string(i));
+
+    // Only libraries can be depended upon
+    const size_t libraries = std::min(i, _options.tasks_ - applications);
+    std::set<size_t> dependencies;
+    const size_t fanOut = std::min(libraries, (application ? applicationFanOut : libraryFanOut)(random));
+    while (dependencies.size() < fanOut)
+      dependencies.insert(pickDependency(random, libraries));
+    for (size_t dependency : dependencies) {
+      Dependency result;
+      result.name_ = taskName(dependency);
+      task.dependencies_.push_back(result);
+    }
+
+    for (size_t j = 0; j < _options.flavors_; j++) {
+      Task flavor;
+      if (j == 0) {
+        flavor.symbols_.emplace("DEBUG", "1");
+        flavor.toolchainFlags_ = {"-g"};
+      } else if (j == 1) {
+        flavor.optimize_ = Task::optimisation_t::SPEED;
+        flavor.symbols_.emplace("NDEBUG", "1");
+      } else {
+        flavor.symbols_.emplace("SYNTHETIC_FLAVOR", std::to_string(j));
+      }
+      task.flavors_.emplace(flavorName(j), flavor);
+    }
+
+    for (size_t j = 0; j < _options.optionals_ && libraries > 0; j++) {
+      Task optional;
+      Dependency dependency;
+      dependency.name_ = taskName(pickDependency(random, libraries));
+      optional.dependencies_.push_back(dependency);
+      optional.symbols_.emplace("SYNTHETIC_OPTIONAL_" + std::to_string(j), "1");
+      task.optionals_.emplace("optional" + std::to_string(j), optional);
+    }
+
+    // The lowest tasks are the most depended upon, export them
+    if (i < _options.exports_)
+      repo.exports_.emplace(name, task);
+    else
+      repo.tasks_.emplace(name, task);
+    repo.all_.push_back(name);
+    if (application)
+      repo.test_.push_back(name);
+  }
+  return repo;
+}
+
+void writeSources(const Repository &_repo, const generator_options_t &_options, const fs::path &_root) {
+  for (const auto *tasks : {&_repo.tasks_, &_repo.exports_}) {
+    for (const auto &pair : *tasks) {
+      const std::string &name = pair.first;
+      const Task &task = pair.second;
+      const bool application = task.type_ == Task::type_t::APPLICATION;
+      fs::create_directories(_root / name / "src");
+
+      std::string includes;
+      for (const Dependency &dependency : task.dependencies_)
+        includes += "#include \"" + dependency.name_ + ".h\"\n";
+      if (!application) {
+        fs::create_directories(_root / name / "inc");
+        std::ofstream header((_root / name / "inc" / (name + ".h")).string());
+        header << "#pragma once\n\n";
+        for (size_t i = 0; i < _options.sources_; i++)
+          header << "int " << name << "_" << i << "(int);\n";
+      }
+
+      for (size_t i = 0; i < _options.sources_; i++) {
+        std::ofstream source((_root / name / "src" / ("source" + std::to_string(i) + ".cpp")).string());
+        source << includes;
+        if (!application)
+          source << "#include \"" << name << ".h\"\n";
+        source << "\nint " << name << "_" << i << "(int _value) {\n  int result = _value;\n";
+        for (const Dependency &dependency : task.dependencies_)
+          source << "  result += " << dependency.name_ << "_" << i << "(_value);\n";
+        source << "  return result;\n}\n";
+        if (application && i == 0)
+          source << "\nint main(int _argc, char **) {\n  return " << name << "_0(_argc);\n}\n";
+      }
+    }
+  }
+}
+
+}  // namespace brief
@@ -0,0 +1,65 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/filesystem/path.hpp>
+
+#include "brief/model/repository.hpp"
+
+namespace brief {
+
+/** Shape of a synthetic repository. */
+struct generator_options_t {
+  /** Tasks of the repository, including exports. */
+  size_t tasks_ = 1000;
+
+  /** Tasks exported instead of local, the most depended upon ones. */
+  size_t exports_ = 0;
+
+  /** Average number of dependencies of a task. */
+  size_t dependencies_ = 4;
+
+  /** Flavors of each task, the first ones being debug and release. */
+  size_t flavors_ = 2;
+
+  /** Optional features of each task, depending on another task. */
+  size_t optionals_ = 0;
+
+  /** Sources of each task. */
+  size_t sources_ = 10;
+
+  /** Same seed, same repository. */
+  uint32_t seed_ = 42;
+};
+
+/**
+ * Generates repositories shaped like large monorepos, to test and benchmark brief at scale.
+ * Tasks are layered, each one only depending on previous ones: a few base libraries are depended upon by most
+ * tasks (high fan-in) and the last tasks, applications, depend on many libraries (high fan-out).
+ */
+Repository generate(const generator_options_t &_options);
+
+/** Writes the headers and sources of a generated repository in *_root*, each source including the headers of
+ * the dependencies of its task. */
+void writeSources(const Repository &_repo, const generator_options_t &_options, const boost::filesystem::path &_root);
+
+}  // namespace brief
@@ -0,0 +1,180 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/model/repository.hpp"
+#include "brief/process.hpp"
+#include "generator.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: brief-noop [--brief <brief executable>] [--runs <count>] [--threshold <ms>]\n"
+    "                  [--tasks <count>] [--sources <count per task>] [--dir <repo directory>]\n"
+    "Builds a synthetic repository once, then times no-op builds each in a new brief process.\n"
+    "Fails if the median no-op build takes longer than the threshold, if any.\n";
+
+/** Phases of a no-op build, as traced by brief, in the order they run. */
+const std::vector<std::string> PHASES = {
+  "Validate cache", "Load cache", "Load state", "Resolve dependencies", "Run actions", "Save state"
+};
+constexpr auto STARTUP = "Process startup and exit";
+constexpr auto TOTAL = "Total";
+
+using ms = std::chrono::duration<double, std::milli>;
+
+/** Extracts the value of a field from a trace event, as written by Tracer (one event per line). */
+std::string field(const std::string &_event, const std::string &_name) {
+  const std::string key = "\"" + _name + "\":";
+  size_t start = _event.find(key);
+  if (start == std::string::npos)
+    return std::string();
+  start += key.size();
+  if (_event[start] == '"')
+    return _event.substr(start + 1, _event.find('"', start + 1) - start - 1);
+  return _event.substr(start, _event.find_first_of(",}", start) - start);
+}
+
+/** Durations of the phases of a no-op build from its trace. */
+std::map<std::string, ms> phases(const fs::path &_trace, ms _wall) {
+  std::map<std::string, ms> result;
+  std::ifstream src(_trace.string());
+  std::string event;
+  int64_t end = 0;
+  while (std::getline(src, event)) {
+    const std::string phase = field(event, "ph"), category = field(event, "cat"), name = field(event, "name");
+    // Counters are only traced when incremented
+    if (phase == "C" && name == "Cache misses")
+      throw std::runtime_error("Build wasn't a no-op, some actions ran: see " + _trace.string());
+    if (phase != "X" || category == "action")
+      continue;
+    const int64_t timestamp = std::atoll(field(event, "ts").c_str());
+    const int64_t duration = std::atoll(field(event, "dur").c_str());
+    result[name] += std::chrono::microseconds(duration);
+    end = std::max(end, timestamp + duration);
+  }
+  result[STARTUP] = _wall - std::chrono::microseconds(end);
+  result[TOTAL] = _wall;
+  return result;
+}
+
+brief::process_result_t run(brief::Spawner &_spawner, const std::vector<std::string> &_args) {
+  brief::process_result_t result = _spawner.run(_args, false);
+  if (result.status_ != 0)
+    throw std::runtime_error("brief failed with status " + std::to_string(result.status_) + ":\n" + result.output_);
+  return result;
+}
+
+}  // namespace
+
+int main(int _argc, char **_argv) {
+  std::string brief = "brief";
+  size_t runs = 10;
+  double threshold = 0;
+  brief::generator_options_t options;
+  options.sources_ = 5;
+  fs::path dir;
+  for (int i = 1; i < _argc; i++) {
+    const std::string arg = _argv[i];
+    if (i + 1 == _argc) {
+      std::cerr << USAGE;
+      return 1;
+    } else if (arg == "--brief") {
+      brief = _argv[++i];
+    } else if (arg == "--runs") {
+      runs = std::max(1ul, std::strtoul(_argv[++i], nullptr, 10));
+    } else if (arg == "--threshold") {
+      threshold = std::strtod(_argv[++i], nullptr);
+    } else if (arg == "--tasks") {
+      options.tasks_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--sources") {
+      options.sources_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg == "--dir") {
+      dir = _argv[++i];
+    } else {
+      std::cerr << USAGE;
+      return 1;
+    }
+  }
+  if (dir.empty()) {
+    dir = fs::temp_directory_path()
+        / ("brief-noop-" + std::to_string(options.tasks_) + "-" + std::to_string(options.sources_));
+  }
+
+  try {
+    // Generated and fully built once, kept for the next runs
+    const fs::path description = dir / "synthetic.brief";
+    const fs::path trace = dir / "noop.trace.json";
+    if (!fs::exists(description)) {
+      std::cout << "Generating " << dir << std::endl;
+      const brief::Repository repo = brief::generate(options);
+      brief::writeSources(repo, options, dir);
+      std::ofstream dst(description.string());
+      brief::json<brief::Repository>::serialize(dst, repo);
+    }
+    brief::Spawner spawner;
+    run(spawner, {brief, "-d", description.string(), "configure"});
+    std::cout << "Building " << dir << std::endl;
+    run(spawner, {brief, "-d", description.string(), "build"});
+
+    std::map<std::string, std::vector<ms>> measures;
+    for (size_t i = 0; i < runs; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      run(spawner, {brief, "-d", description.string(), "--trace=" + trace.string(), "build"});
+      const ms wall = std::chrono::steady_clock::now() - start;
+      for (const auto &phase : phases(trace, wall))
+        measures[phase.first].push_back(phase.second);
+    }
+
+    std::vector<std::string> names = {STARTUP};
+    names.insert(names.end(), PHASES.begin(), PHASES.end());
+    names.push_back(TOTAL);
+    std::cout << std::left << std::setw(28) << "No-op build phase (ms)" << std::right << std::setw(10) << "min"
+              << std::setw(10) << "median" << std::setw(10) << "max" << std::fixed << std::setprecision(2) << std::endl;
+    for (const std::string &name : names) {
+      std::vector<ms> &values = measures[name];
+      values.resize(runs);
+      std::sort(values.begin(), values.end());
+      std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << values.front().count()
+                << std::setw(10) << values[runs / 2].count() << std::setw(10) << values.back().count() << std::endl;
+    }
+
+    const double median = measures[TOTAL][runs / 2].count();
+    if (threshold > 0 && median > threshold) {
+      std::cerr << "No-op build took " << median << "ms, over the threshold of " << threshold << "ms" << std::endl;
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
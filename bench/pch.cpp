@@ -0,0 +1,72 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <benchmark/benchmark.h>
+
+#include "brief/context.hpp"
+#include "generator.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+/** Builds a generated repository from scratch with clang, its tasks precompiling their headers or not, and reports
+ * the average frontend time per translation unit, to compare both runs. */
+void PrecompiledHeaders(benchmark::State &_state) {
+  brief::generator_options_t options;
+  options.tasks_ = 20;
+  options.sources_ = 10;
+  brief::Repository repo = brief::generate(options);
+  for (auto *tasks : {&repo.tasks_, &repo.exports_}) {
+    for (auto &task : *tasks)
+      task.second.precompileHeaders_ = _state.range(0) != 0;
+  }
+
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-pch-%%%%-%%%%");
+  brief::writeSources(repo, options, root);
+  const fs::path description = root / "synthetic.brief";
+  {
+    std::ofstream dst(description.string());
+    brief::json<brief::Repository>::serialize(dst, repo);
+  }
+
+  uint64_t units = 0, frontend = 0;
+  for (auto _ : _state) {
+    _state.PauseTiming();
+    fs::remove_all(root / brief::Builder::OUTPUT_DIR);
+    brief::Context ctx(brief::Logger::W);
+    ctx.builder_.buildCache(description, {});
+    _state.ResumeTiming();
+
+    ctx.builder_.build(repo.all_, {}, brief::build_options_t());
+    const auto snapshot = ctx.metrics_.histogram("brief_frontend_duration_microseconds",
+                                                 "Time to parse a translation unit.").snapshot();
+    units += snapshot.count_;
+    frontend += snapshot.sum_;
+  }
+  _state.counters["frontend_us_per_unit"] = units > 0 ? static_cast<double>(frontend) / units : 0;
+  fs::remove_all(root);
+}
+BENCHMARK(PrecompiledHeaders)->Arg(0)->Arg(1)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -0,0 +1,68 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "brief/model/repository.hpp"
+#include "brief/logger.hpp"
+#include "brief/scheduler.hpp"
+#include "generator.hpp"
+
+namespace {
+
+/** Schedules empty actions shaped like a build of a generated repository: a compile action per source, pipelined
+ * on the interface of dependencies, and a link action per task. Measures the overhead of the scheduler alone. */
+void Schedule(benchmark::State &_state) {
+  brief::generator_options_t options;
+  options.tasks_ = _state.range(0);
+  options.sources_ = 10;
+  const brief::Repository repo = brief::generate(options);
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+
+  size_t actions = 0;
+  for (auto _ : _state) {
+    brief::Scheduler scheduler(logger);
+    std::unordered_map<std::string, std::pair<brief::Scheduler::id_t, brief::Scheduler::id_t>> planned;
+    for (const std::string &name : repo.all_) {
+      const brief::Task &task = repo.tasks_.count(name) ? repo.tasks_.find(name)->second
+                                                        : repo.exports_.find(name)->second;
+      std::vector<brief::Scheduler::id_t> interfaces, outputs;
+      for (const brief::Dependency &dependency : task.dependencies_) {
+        interfaces.push_back(planned.at(dependency.name_).first);
+        outputs.push_back(planned.at(dependency.name_).second);
+      }
+      const auto interface = scheduler.milestone(name + " interface", interfaces);
+      for (size_t i = 0; i < options.sources_; i++)
+        outputs.push_back(scheduler.add("Compile " + name + std::to_string(i), []() {}, {interface}));
+      const auto link = scheduler.add("Link " + name, []() {}, outputs);
+      planned.emplace(name, std::make_pair(interface, scheduler.milestone(name + " output", {link})));
+    }
+    scheduler.run();
+    actions = planned.size() * (options.sources_ + 3);
+  }
+  _state.SetItemsProcessed(_state.iterations() * actions);
+}
+BENCHMARK(Schedule)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -0,0 +1,127 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "brief/model/repository.hpp"
+#include "generator.hpp"
+
+namespace {
+
+brief::Repository synthesize(size_t _tasks) {
+  brief::generator_options_t options;
+  options.tasks_ = _tasks;
+  return brief::generate(options);
+}
+
+std::string serialize(const brief::Repository &_repo) {
+  std::stringstream dest;
+  brief::json<brief::Repository>::serialize(dest, _repo);
+  return dest.str();
+}
+
+void sizes(benchmark::internal::Benchmark *_benchmark) {
+  _benchmark->RangeMultiplier(10)->Range(10, 10000)->Unit(benchmark::kMicrosecond);
+}
+
+void Tokenize(benchmark::State &_state) {
+  const std::string source = serialize(synthesize(_state.range(0)));
+  for (auto _ : _state) {
+    brief::Tokenizer tokenizer(source.data(), source.data() + source.size());
+    while (tokenizer.hasNext())
+      benchmark::DoNotOptimize(tokenizer.next());
+  }
+  _state.SetBytesProcessed(_state.iterations() * source.size());
+}
+BENCHMARK(Tokenize)->Apply(sizes);
+
+void JsonParse(benchmark::State &_state) {
+  const std::string source = serialize(synthesize(_state.range(0)));
+  for (auto _ : _state) {
+    brief::Tokenizer tokenizer(source.data(), source.data() + source.size());
+    brief::Repository repo;
+    brief::json<brief::Repository>::parse(tokenizer, repo);
+    benchmark::DoNotOptimize(repo);
+  }
+  _state.SetBytesProcessed(_state.iterations() * source.size());
+}
+BENCHMARK(JsonParse)->Apply(sizes);
+
+void JsonSerialize(benchmark::State &_state) {
+  const brief::Repository repo = synthesize(_state.range(0));
+  size_t size = 0;
+  for (auto _ : _state) {
+    std::stringstream dest;
+    brief::json<brief::Repository>::serialize(dest, repo);
+    size = dest.tellp();
+  }
+  _state.SetBytesProcessed(_state.iterations() * size);
+}
+BENCHMARK(JsonSerialize)->Apply(sizes);
+
+void MsgpackWrite(benchmark::State &_state) {
+  const brief::Repository repo = synthesize(_state.range(0));
+  size_t size = 0;
+  for (auto _ : _state) {
+    std::stringstream dest;
+    brief::msgpack<brief::Repository>::write(dest, repo);
+    size = dest.tellp();
+  }
+  _state.SetBytesProcessed(_state.iterations() * size);
+}
+BENCHMARK(MsgpackWrite)->Apply(sizes);
+
+void MsgpackRead(benchmark::State &_state) {
+  std::stringstream source;
+  brief::msgpack<brief::Repository>::write(source, synthesize(_state.range(0)));
+  const std::string packed = source.str();
+  for (auto _ : _state) {
+    std::stringstream src(packed);
+    brief::Repository repo;
+    brief::msgpack<brief::Repository>::read(src, repo);
+    benchmark::DoNotOptimize(repo);
+  }
+  _state.SetBytesProcessed(_state.iterations() * packed.size());
+}
+BENCHMARK(MsgpackRead)->Apply(sizes);
+
+void TaskMerge(benchmark::State &_state) {
+  const brief::Repository repo = synthesize(_state.range(0));
+  for (auto _ : _state) {
+    for (const auto &task : repo.tasks_)
+      benchmark::DoNotOptimize(task.second.merge(task.second.flavors_.find("release")->second));
+  }
+  _state.SetItemsProcessed(_state.iterations() * repo.tasks_.size());
+}
+BENCHMARK(TaskMerge)->Apply(sizes);
+
+void GetTask(benchmark::State &_state) {
+  brief::Repository repo = synthesize(_state.range(0));
+  for (auto _ : _state) {
+    for (const std::string &name : repo.all_)
+      benchmark::DoNotOptimize(repo.getTask(name));
+  }
+  _state.SetItemsProcessed(_state.iterations() * repo.all_.size());
+}
+BENCHMARK(GetTask)->Apply(sizes);
+
+}  // namespace
@@ -16,13 +16,22 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "brief/context.hpp"
+#include "brief/jobserver.hpp"
 
 /* Cur dir:
  * TODO Import <cmake script = CMakeLists.txt>
  *   Try to imports targets from a CMake config file to output a repository description.
  *     -i for an interactive
- * TODO Configure <optional features to be enable, prefixed by <task>: as per Dependency.require = [""]> -d <JSON repo description>
+ * Configure <optional features to be enable, prefixed by <task>: as per Dependency.require = [""]> -d <JSON repo description>
  *   Parse repo description file and merges tasks with optional experimental tasks, as well as merging inherited tasks
  *   for faster access when building. Serialize the output in binary to avoid having to unescape strings or parse
  *   fields in any order.
@@ -31,8 +40,9 @@
  *   Checks that any var is preprocessable.
  * TODO Clean <tasks to clean = (cache.all)>
  *   Remove any build system generated temporary file.
- * TODO Build <task to build = (cache.all)>:<flavors to activate = (release)>
- *
+ * Build <tasks to build = (cache.all)> -j <jobs = (hardware concurrency)> -m <memory budget = (available memory)>
+ *   Builds tasks with the configured flavors, starting dependents as soon as they can compile.
+ *   Joins the jobserver of make when run from a makefile, or serves one to the processes it spawns.
  * TODO Test
  *
  * System:
@@ -44,14 +54,127 @@
 
 namespace fs = boost::filesystem;
 
-int main(int, char **) {
-  brief::Context ctx;
+namespace {
 
+constexpr auto USAGE =
+    "usage: brief [-d <repo description>] [--trace=<file>] [--log=<levels>] configure [<flavors>...]\n"
+    "       brief [-d <repo description>] [--trace=<file>] [--log=<levels>] [-j <jobs>] [-m <memory budget in MiB>]\n"
+    "             build [<tasks>...]\n"
+    "       brief log-decode <binary log>\n"
+    "--trace writes where time went as Chrome trace events, see chrome://tracing or https://ui.perfetto.dev\n"
+    "--log sets verbosity, e.g. --log=warn,scheduler=debug, levels are warn, info, verbose and debug, subsystems\n"
+    "      parser, cache, scheduler, trunks and vcs\n"
+    "--binlog writes every parse, plan and action to a binary log, rendered as text by log-decode\n"
+    "--metrics writes counters and latencies once done, as JSON if the file ends with .json, else for Prometheus\n";
+
+/** Looks for a repo description in the current directory. */
+fs::path findDescription() {
+  fs::path json;
   for (auto file : fs::directory_iterator(fs::current_path())) {
-    if (file.path().extension() == ".json") {
-      break;
+    if (file.path().extension() == ".brief")
+      return file.path();
+    if (file.path().extension() == ".json" && json.empty())
+      json = file.path();
+  }
+  if (json.empty())
+    throw std::runtime_error("No repo description in current directory, use -d <repo description>.");
+  return json;
+}
+
+}  // namespace
+
+int main(int _argc, char **_argv) {
+  brief::Context ctx(brief::Logger::I);
+
+  fs::path description, metrics;
+  brief::build_options_t options;
+  std::vector<std::string> args;
+  for (int i = 1; i < _argc; i++) {
+    const std::string arg = _argv[i];
+    if (arg == "-d" && i + 1 < _argc) {
+      description = _argv[++i];
+    } else if (arg == "-j" && i + 1 < _argc) {
+      options.jobs_ = std::strtoul(_argv[++i], nullptr, 10);
+    } else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) {
+      options.jobs_ = std::strtoul(arg.c_str() + 2, nullptr, 10);
+    } else if (arg == "-m" && i + 1 < _argc) {
+      options.memoryBudget_ = std::strtoull(_argv[++i], nullptr, 10) * 1024;
+    } else if (arg.compare(0, 8, "--trace=") == 0) {
+      ctx.tracer_.open(arg.substr(8));
+      ctx.tracer_.nameThread("Main");
+    } else if (arg.compare(0, 9, "--binlog=") == 0) {
+      ctx.binlog_.open(arg.substr(9));
+    } else if (arg.compare(0, 10, "--metrics=") == 0) {
+      metrics = arg.substr(10);
+    } else if (arg.compare(0, 6, "--log=") == 0) {
+      try {
+        ctx.logger_.configure(arg.substr(6));
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n' << USAGE;
+        return 1;
+      }
+    } else {
+      args.push_back(arg);
     }
   }
+  if (args.empty()) {
+    std::cerr << USAGE;
+    return 1;
+  }
+
+  int status = 0;
+  try {
+    const std::string command = args.front();
+    args.erase(args.begin());
+    if (command == "log-decode") {
+      if (args.size() != 1) {
+        std::cerr << USAGE;
+        return 1;
+      }
+      std::ifstream src(args.front(), std::ios::binary);
+      if (!src)
+        throw std::runtime_error("Can't read binary log " + args.front());
+      brief::BinaryLog::decode(src, std::cout);
+      return 0;
+    }
+
+    if (description.empty())
+      description = findDescription();
+    if (command == "configure") {
+      ctx.builder_.buildCache(description, args);
+    } else if (command == "build") {
+      ctx.builder_.loadCachedDesc(description);
+      if (args.empty())
+        args = ctx.builder_.repo().all_;
+      if (args.empty())
+        throw std::runtime_error("Nothing to build, list tasks in the \"all\" field of the repo description.");
+      const char *makeflags = std::getenv("MAKEFLAGS");
+      std::unique_ptr<brief::Jobserver> jobserver = brief::Jobserver::join(makeflags ? makeflags : "");
+      if (jobserver) {
+        BRIEF_V(ctx.logger_, "Joined jobserver of make");
+      } else {
+        jobserver = brief::Jobserver::create(options.jobs_ ? options.jobs_ : std::thread::hardware_concurrency());
+        ctx.spawner_.setEnv("MAKEFLAGS", jobserver->makeflags());
+      }
+      options.jobserver_ = jobserver.get();
+      ctx.builder_.build(args, ctx.builder_.flavors(), options);
+    } else {
+      std::cerr << USAGE;
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    BRIEF_W(ctx.logger_, e.what());
+    status = 1;
+  }
 
-  return 0;
+  // Failed runs are measured too
+  if (!metrics.empty()) {
+    try {
+      ctx.metrics_.write(metrics);
+    } catch (const std::exception &e) {
+      BRIEF_W(ctx.logger_, e.what());
+      status = 1;
+    }
+  }
+  return status;
 }
@@ -17,10 +17,16 @@ endif (CLANG_${_libname_}_LIB)
 ENDMACRO(FIND_AND_ADD_CLANG_LIB)
 
 # Clang shared library provides just the limited C interface, so it
-# can not be used.  We look for the static libraries.
+# can not be used.  We look for the static libraries, or the C++ API
+# shared library shipped by recent releases.
+find_library(CLANG_CPP_LIB clang-cpp ${LLVM_LIBRARY_DIRS} ${CLANG_LIBRARY_DIRS})
+if (CLANG_CPP_LIB)
+   set(CLANG_LIBS ${CLANG_CPP_LIB})
+else (CLANG_CPP_LIB)
 FIND_AND_ADD_CLANG_LIB(clangFrontend)
 FIND_AND_ADD_CLANG_LIB(clangDriver)
 FIND_AND_ADD_CLANG_LIB(clangCodeGen)
+FIND_AND_ADD_CLANG_LIB(clangSerialization)
 FIND_AND_ADD_CLANG_LIB(clangEdit)
 FIND_AND_ADD_CLANG_LIB(clangSema)
 FIND_AND_ADD_CLANG_LIB(clangChecker)
@@ -30,6 +36,7 @@ FIND_AND_ADD_CLANG_LIB(clangAST)
 FIND_AND_ADD_CLANG_LIB(clangParse)
 FIND_AND_ADD_CLANG_LIB(clangLex)
 FIND_AND_ADD_CLANG_LIB(clangBasic)
+endif (CLANG_CPP_LIB)
 
 find_path(CLANG_INCLUDE_DIRS clang/Basic/Version.h HINTS ${LLVM_INCLUDE_DIRS})
 
@@ -0,0 +1,165 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * Logs to a BinaryLog if it is enabled, the format being registered once per call site. "{}" in *FORMAT* are
+ * replaced by the arguments when decoding, which must be integers, floating points or strings.
+ */
+#define BRIEF_BIN(LOG, FORMAT, ...) \
+  do { \
+    if ((LOG).enabled()) { \
+      static const uint32_t brief_bin_format_ = ::brief::BinaryLog::format(FORMAT); \
+      (LOG).log(brief_bin_format_, ##__VA_ARGS__); \
+    } \
+  } while (false)
+
+/**
+ * Log of hot paths with deferred formatting: lines only record the id of a static format, a timestamp and the raw
+ * bytes of their arguments, decode() renders them as text afterwards ("brief log-decode").
+ * Threads append to buffers of their own, written to the file once full, on flush and on destruction, along with
+ * the formats registered since the last write. Numbers are in native byte order.
+ * Does nothing until opened. Thread safe.
+ */
+class BinaryLog {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  BinaryLog();
+
+  /** Writes buffered lines, if logging was enabled. */
+  ~BinaryLog();
+
+  BinaryLog(const BinaryLog&) = delete;
+  BinaryLog& operator=(const BinaryLog&) = delete;
+
+  /** Starts logging to *_path*. Must be called before other threads log. */
+  void open(const boost::filesystem::path &_path);
+  bool enabled() const { return enabled_; }
+
+  /** Registers a format, returns its id, shared by every log. */
+  static uint32_t format(const char *_format);
+
+  /** Appends a line to the buffer of the calling thread, see BRIEF_BIN. */
+  template <typename... Args>
+  void log(uint32_t _format, const Args &... _args) {
+    if (!enabled())
+      return;
+    const uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin_).count();
+    buffer_t &buffer = this->buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex_);
+    put(buffer.data_, _format);
+    put(buffer.data_, time);
+    put(buffer.data_, static_cast<uint8_t>(sizeof...(Args)));
+    const int unused[] = {0, (arg(buffer.data_, _args), 0)...};
+    (void)unused;
+    if (buffer.data_.size() >= BUFFER_SIZE)
+      write(buffer);
+  }
+
+  /** Writes the lines buffered by every thread, also done on destruction. */
+  void flush();
+
+  /** Renders a binary log as text, lines ordered by time. Throws on anything but a binary log, after rendering the
+   * complete lines of a truncated one. */
+  static void decode(std::istream &_src, std::ostream &_dst);
+
+ private:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+  struct buffer_t {
+    /** Only contended on flush. */
+    std::mutex mutex_;
+    std::string data_;
+    uint32_t thread_;
+  };
+
+  bool enabled_ = false;
+  Clock::time_point origin_;
+
+  /** Identifies the buffers of this log in the threads it is used from. */
+  uint64_t id_ = nextId_++;
+  static std::atomic<uint64_t> nextId_;
+
+  std::mutex buffersMutex_;
+  std::vector<std::unique_ptr<buffer_t>> buffers_;
+
+  /** Guards the file and the count of formats written to it. */
+  std::mutex mutex_;
+  std::ofstream file_;
+  size_t formats_ = 0;
+
+  buffer_t& buffer();
+
+  /** Writes the lines of a buffer whose mutex is locked. */
+  void write(buffer_t &_buffer);
+
+  template <typename T>
+  static void put(std::string &_dst, T _value) {
+    _dst.append(reinterpret_cast<const char*>(&_value), sizeof(T));
+  }
+
+  static void put(std::string &_dst, char _type, const char *_data, size_t _size) {
+    _dst.push_back(_type);
+    put(_dst, static_cast<uint32_t>(_size));
+    _dst.append(_data, _size);
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+  arg(std::string &_dst, T _value) {
+    _dst.push_back('i');
+    put(_dst, static_cast<int64_t>(_value));
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+  arg(std::string &_dst, T _value) {
+    _dst.push_back('u');
+    put(_dst, static_cast<uint64_t>(_value));
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value>::type arg(std::string &_dst, T _value) {
+    _dst.push_back('f');
+    put(_dst, static_cast<double>(_value));
+  }
+
+  static void arg(std::string &_dst, const std::string &_value) { put(_dst, 's', _value.data(), _value.size()); }
+  static void arg(std::string &_dst, const char *_value) { put(_dst, 's', _value, std::strlen(_value)); }
+};
+
+}  // namespace brief
@@ -18,16 +18,34 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 #include <string>
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
 
 #include "brief/model/repository.hpp"
+#include "brief/state.hpp"
+#include "brief/toolchain.hpp"
 
 namespace brief {
 
 class Context;
+class Jobserver;
+
+/** How to run a build. */
+struct build_options_t {
+  /** Maximum number of actions running at once, 0 for the hardware concurrency. */
+  size_t jobs_ = 0;
+
+  /** Memory budget of running actions in KiB, 0 to only limit them to the available memory. */
+  uint64_t memoryBudget_ = 0;
+
+  /** Jobserver limiting parallelism with other processes on top of jobs_, if any. */
+  Jobserver *jobserver_ = nullptr;
+};
 
 /**
  * Class responsible for parsing JSON build files, and schedule tasks building.
@@ -35,6 +53,7 @@ class Context;
 class Builder {
  public:
   static constexpr auto CACHE_SUFFIX = ".cache";
+  static constexpr auto OUTPUT_DIR = "build";
 
   explicit Builder(Context &_ctx) : ctx_(_ctx) {}
 
@@ -42,11 +61,42 @@ class Builder {
   void loadCachedDesc();
   void loadCachedDesc(const boost::filesystem::path &_repodesc);
 
-  void build(const std::string &_task, const std::vector<std::string> &_flavors);
+  /** Builds tasks and the tasks of this repo they depend on. Each task gets the flavors it knows among *_flavors*,
+   * plus the ones it is required with by its dependents. */
+  void build(const std::vector<std::string> &_tasks, const std::vector<std::string> &_flavors,
+             const build_options_t &_options = build_options_t());
+  void build(const std::string &_task, const std::vector<std::string> &_flavors,
+             const build_options_t &_options = build_options_t()) {
+    build(std::vector<std::string> {_task}, _flavors, _options);
+  }
+
+  const Repository &repo() const { return repo_; }
+
+  /** What previous builds produced, loaded during builds. */
+  BuildState &state() { return state_; }
+
+  /** Flavors the repo was configured with. */
+  const std::vector<std::string> &flavors() const { return flavors_; }
+
+  /** Directory of the loaded repo description, task paths are relative to it. */
+  const boost::filesystem::path &root() const { return root_; }
+
+  /** Where toolchains should write outputs of a task built with some flavors. */
+  boost::filesystem::path outputDir(const std::string &_task, const std::vector<std::string> &_flavors) const;
 
  private:
   Context &ctx_;
   Repository repo_;
+  boost::filesystem::path root_;
+  std::vector<std::string> flavors_;
+  BuildState state_;
+
+  struct planning_t;
+
+  Task merge(const std::string &_task, const std::vector<std::string> &_flavors);
+  std::vector<std::string> knownFlavors(const std::string &_task, const std::vector<std::string> &_flavors,
+                                        const std::vector<std::string> &_required = {});
+  Toolchain::plan_t plan(planning_t &_planning, const std::string &_task, const std::vector<std::string> &_flavors);
 };
 
 }  // namespace brief
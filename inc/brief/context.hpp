@@ -18,27 +18,48 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <string>
-#include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
 
 #include "brief/model/repository.hpp"
+#include "brief/binlog.hpp"
+#include "brief/process.hpp"
+#include "brief/scope.hpp"
+#include "brief/template.hpp"
 #include "brief/toolchain.hpp"
 #include "brief/vcs.hpp"
 #include "brief/builder.hpp"
 #include "brief/trunks.hpp"
 #include "brief/logger.hpp"
+#include "brief/matcher.hpp"
+#include "brief/metrics.hpp"
+#include "brief/trace.hpp"
 
 namespace brief {
 
+/**
+ * Registries of toolchains, VCS handlers and variables, and the services shared by a build.
+ * Registration happens from a single thread (while loading plugins), until freeze() is called. Registries are then
+ * an immutable snapshot that any thread reads without locking, late registrations publish a modified copy. Superseded
+ * snapshots are kept until the Context is destroyed.
+ */
 class Context {
  public:
   Logger logger_;
+  Tracer tracer_;
+  BinaryLog binlog_;
+  Metrics metrics_;
+  Spawner spawner_;
   Builder builder_;
   Trunks trunks_;
 
@@ -46,22 +67,67 @@ class Context {
 
   using PrefixCallback = std::function<std::string(const Repository &, const Task &, const std::string &_name)>;
 
+  /** Replaces any toolchain registered with the same name, instances already created are kept by their users. */
   void registerToolchain(const std::string &_name, const Toolchain::Factory &_factory);
+
+  /** Handles URIs fully matching an ECMAScript *_pattern*, patterns being tried in registration order.
+   * URIs are only matched against the patterns they start with the literal prefix of, see UriMatcher. */
+  void registerVCSHandling(const std::string &_pattern, const VCS::Factory &_factory);
+
+  /** Same, but as the prefix of a compiled pattern is unknown, it is tried for every URI. */
   void registerVCSHandling(const std::regex &_pattern, const VCS::Factory &_factory);
 
   std::shared_ptr<VCS> getVCS(const std::string &_uri);
+
+  /** Shared instance of a toolchain, or if it isn't reentrant the instance of the calling scheduler worker (or thread
+   * off workers), kept until the context is destroyed. Builds of a context must then not run at once.
+   * Reentrant toolchains are read from the registries without locking once created, others lock their instances. */
   std::shared_ptr<Toolchain> getToolchain(const std::string &_name);
 
+  /** Registers or replaces a variable, only the expansions that used it are invalidated. */
   void registerVar(const std::string &_name, const std::string &_value);
   void registerVarPrefix(const std::string &_prefix, PrefixCallback _cb);
+
+  /** Expands the variables referenced by a string, use a Scope to expand many strings of a task. */
   std::string preprocessString(const Repository &_repo, const Task &_task, const std::string &_value);
+
+  /** Looks up a single variable, use a Scope to look up many variables of a task. */
   std::string lookupVar(const Repository &_repo, const Task &_task, const std::string &_name);
 
+  /** Ends the registration phase, registries can then be read from any thread. Done when a build starts. */
+  void freeze();
+  bool frozen() const { return frozen_; }
+
  private:
-  std::unordered_map<std::string, Toolchain::Factory> toolchainFactories_;
-  std::unordered_map<std::string, PrefixCallback> varPrefixes_;
-  std::unordered_map<std::string, std::string> knownVars_;
-  std::vector<std::tuple<std::regex, VCS::Factory>> vcsFactories_;
+  friend class Scope;
+
+  struct toolchain_entry_t;
+
+  /** Everything registered, immutable once published. */
+  struct registries_t {
+    std::unordered_map<std::string, std::shared_ptr<toolchain_entry_t>> toolchains_;
+    std::unordered_map<std::string, PrefixCallback> varPrefixes_;
+    std::unordered_map<std::string, std::string> knownVars_;
+    std::unordered_map<std::string, uint64_t> varVersions_;
+    UriMatcher vcsPatterns_;
+    std::vector<VCS::Factory> vcsFactories_;
+  };
+
+  /** Latest snapshot, read with an acquire load. Modified in place by registrations until frozen. */
+  std::atomic<const registries_t*> registries_ {nullptr};
+
+  /** Every snapshot published, superseded ones being kept alive for the readers that may still use them. */
+  std::vector<std::unique_ptr<registries_t>> snapshots_;
+  std::mutex registration_;
+  std::atomic<bool> frozen_ {false};
+
+  /** Compiled templates, shared by the scopes of this context. */
+  TemplateCache templates_;
+
+  const registries_t &registries() const { return *registries_.load(std::memory_order_acquire); }
+
+  /** Applies a registration, publishing a modified copy of the registries once frozen. */
+  void update(const std::function<void(registries_t &_registries)> &_change);
 };
 
 }  // namespace brief
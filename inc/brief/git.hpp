@@ -0,0 +1,72 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+struct git_repository;
+
+namespace brief {
+
+/**
+ * Bare repository driven with libgit2, storing the objects of an upstream for all of its checkouts in the trunks.
+ * Fetches resume: the objects of completed fetches are kept in the repository, an interrupted fetch only gets again
+ * what it misses. An instance must only be used by one thread at a time, distinct repositories can fetch in parallel.
+ */
+class GitRepository {
+ public:
+  /** Depth of a fetch getting the whole history, deepening a shallow repository. */
+  static constexpr int FULL = 0;
+
+  /** Opens the bare repository in *_dir*, or initializes it with *_url* as origin if there's none. */
+  GitRepository(const boost::filesystem::path &_dir, const std::string &_url);
+  ~GitRepository();
+
+  GitRepository(const GitRepository&) = delete;
+  GitRepository& operator=(const GitRepository&) = delete;
+
+  /** Names of the references of origin, listed without fetching anything. */
+  std::vector<std::string> references();
+
+  /** Fetches *_refspecs* from origin, the last *_depth* commits of each or FULL, returns the bytes received. */
+  uint64_t fetch(const std::vector<std::string> &_refspecs, int _depth);
+
+  /** Id of the commit a reference or revision points to, empty if it isn't fetched. */
+  std::string resolve(const std::string &_rev);
+
+  /** Whether *_commit* is *_ancestor* or descends from it, both being fetched with their history. */
+  bool contains(const std::string &_commit, const std::string &_ancestor);
+
+  /**
+   * Checks out a commit in *_dir*, a repository borrowing the objects of this one through git alternates rather than
+   * copying them.
+   */
+  void checkout(const std::string &_id, const boost::filesystem::path &_dir);
+
+ private:
+  git_repository *repo_ = nullptr;
+  std::string url_;
+};
+
+}  // namespace brief
@@ -0,0 +1,37 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * Expands a repo local path pattern, as used in Task::sources_ or Task::headers_.
+ * "*" matches any file in a directory, "**" any file in this directory and subdirectories.
+ * Like in shells, wildcards don't match hidden files. "**" doesn't descend into hidden directories, symlinks to
+ * directories, or the build output directory of the repo.
+ * Returned paths are relative to *_root* and sorted, patterns without wildcards are returned as is.
+ */
+std::vector<boost::filesystem::path> glob(const boost::filesystem::path &_root, const std::string &_pattern);
+
+}  // namespace brief
@@ -0,0 +1,66 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * 64 bits FNV-1a, used to fingerprint build inputs and outputs.
+ * Not cryptographically safe, it's only meant to detect changes.
+ */
+class Hasher {
+ public:
+  Hasher &update(const void *_data, size_t _size) {
+    const auto *cur = static_cast<const uint8_t*>(_data);
+    const auto *end = cur + _size;
+    while (cur != end) {
+      state_ ^= *cur++;
+      state_ *= 1099511628211ULL;
+    }
+    return *this;
+  }
+
+  /** Hashes the size first, so that a list of strings can't collide with their concatenation. */
+  Hasher &update(const std::string &_str) {
+    const uint64_t size = _str.size();
+    update(&size, sizeof(size));
+    return update(_str.data(), _str.size());
+  }
+
+  Hasher &update(uint64_t _value) {
+    return update(&_value, sizeof(_value));
+  }
+
+  uint64_t digest() const { return state_; }
+
+ private:
+  uint64_t state_ = 14695981039346656037ULL;
+};
+
+/** Hashes the content of a file, throws if it can't be read. */
+uint64_t hashFile(const boost::filesystem::path &_path);
+
+}  // namespace brief
@@ -0,0 +1,80 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * GNU make jobserver, sharing one -j among a whole process tree through a pipe or a fifo holding tokens.
+ * Each process owns an implicit job, and must read a token from the jobserver for each additional job it runs
+ * in parallel, then write it back once done.
+ * Brief joins the jobserver of make when it is invoked by it, or serves one to its subprocesses.
+ */
+class Jobserver {
+ public:
+  /** Joins the jobserver advertised in a MAKEFLAGS value, in its fifo (--jobserver-auth=fifo:PATH) or pipe
+   * (--jobserver-auth=R,W or --jobserver-fds=R,W) form. Returns null if none is usable. */
+  static std::unique_ptr<Jobserver> join(const std::string &_makeflags);
+
+  /** Serves *_jobs* jobs through a fifo, including the implicit one of this process. */
+  static std::unique_ptr<Jobserver> create(size_t _jobs);
+
+  ~Jobserver();
+
+  /** Waits for a token, returns false if interrupted. */
+  bool acquire();
+
+  /** Takes a token if one is available right away. */
+  bool tryAcquire();
+
+  /** Gives back a token acquired before. */
+  void release();
+
+  /** Wakes up a pending or the next acquire call. */
+  void interrupt();
+
+  /** MAKEFLAGS value making subprocesses join this jobserver, only meaningful for fifo jobservers as our
+   * descriptors aren't inherited (subprocesses of a pipe jobserver client inherit the MAKEFLAGS of make). */
+  std::string makeflags() const;
+
+ private:
+  Jobserver(int _read, int _write, const boost::filesystem::path &_fifo, bool _owner);
+
+  int read_, write_, interrupt_;
+  boost::filesystem::path fifo_;
+  bool owner_;
+  size_t jobs_ = 0;
+
+  /** Tokens must be written back as they were read. */
+  std::mutex mutex_;
+  std::vector<char> held_;
+
+  bool take();
+};
+
+}  // namespace brief
@@ -297,6 +297,22 @@ BRIEF_JSON_BIND_INT(uint32_t, strtoul)
 BRIEF_JSON_BIND_INT(uint64_t, strtoul)
 BRIEF_JSON_BIND_INT(unsigned long long, strtoull)
 
+template <>
+struct json<bool> {
+  static void parse(Tokenizer &_tokenizer, bool &_dest) {
+    token_t token = _tokenizer.expect(token_t::type_t::IDENTIFIER);
+    if (token.view_ == "true")
+      _dest = true;
+    else if (token.view_ == "false")
+      _dest = false;
+    else
+      throwError(token.line_, token.col_, std::string("expected boolean, found: ") + token.view_.to_string());
+  }
+  static void serialize(std::ostream &_stream, const bool &_ref, int _indent = 0) {
+    _stream << (_ref ? "true" : "false");
+  }
+};
+
 #define BRIEF_JSON_BIND_FLOAT(CTYPE, FUNC) \
   template <> \
   struct json<CTYPE> { \
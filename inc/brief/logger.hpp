@@ -18,23 +18,53 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "brief/json.hpp"
 
 namespace brief {
 
-#define BRIEF_W(LOGGER, OPS) do { LOGGER.w() << OPS << std::endl; } while (false)
-#define BRIEF_I(LOGGER, OPS) do { LOGGER.i() << OPS << std::endl; } while (false)
-#define BRIEF_V(LOGGER, OPS) do { LOGGER.v() << OPS << std::endl; } while (false)
+/** Logs unless *LEVEL* is filtered for *SUBSYSTEM*, in which case *OPS* isn't evaluated. */
+#define BRIEF_LOG(LOGGER, LEVEL, SUBSYSTEM, OPS) \
+  do { \
+    if ((LOGGER).enabled(LEVEL, SUBSYSTEM)) { \
+      (LOGGER).begin() << OPS; \
+      (LOGGER).commit(LEVEL, SUBSYSTEM); \
+    } \
+  } while (false)
+
+#define BRIEF_W(LOGGER, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::W, ::brief::Logger::GENERAL, OPS)
+#define BRIEF_I(LOGGER, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::I, ::brief::Logger::GENERAL, OPS)
+#define BRIEF_V(LOGGER, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::V, ::brief::Logger::GENERAL, OPS)
+
+/** Logging of a subsystem, verbosity can be set per subsystem, e.g. BRIEF_SD(logger, SCHEDULER, "..."). */
+#define BRIEF_SW(LOGGER, SUBSYSTEM, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::W, ::brief::Logger::SUBSYSTEM, OPS)
+#define BRIEF_SI(LOGGER, SUBSYSTEM, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::I, ::brief::Logger::SUBSYSTEM, OPS)
+#define BRIEF_SV(LOGGER, SUBSYSTEM, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::V, ::brief::Logger::SUBSYSTEM, OPS)
 
 #ifdef NDEBUG
 #define BRIEF_D(LOGGER, OPS) do { } while ( false )
+#define BRIEF_SD(LOGGER, SUBSYSTEM, OPS) do { } while ( false )
 #else
-#define BRIEF_D(LOGGER, OPS) do { LOGGER.d() << OPS << std::endl; } while (false)
+#define BRIEF_D(LOGGER, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::D, ::brief::Logger::GENERAL, OPS)
+#define BRIEF_SD(LOGGER, SUBSYSTEM, OPS) BRIEF_LOG(LOGGER, ::brief::Logger::D, ::brief::Logger::SUBSYSTEM, OPS)
 #endif
 
 #define BRIEF_LOGGER_APPEND_MAP(CTYPE) \
@@ -99,6 +129,12 @@ inline std::ostream& operator<<(std::ostream &_out, const std::chrono::duration<
 
 /**
  * Class responsible for logging messages.
+ * Lines are formatted by the thread logging them, then pushed to a ring buffer of that thread, which a writer thread
+ * drains to write them to the target stream in batches, ordered by time. The writer sleeps until lines are committed,
+ * only the first line committed after it drained the rings waking it, so logging threads don't share a lock otherwise,
+ * unless their ring is full. Warnings are flushed before BRIEF_W returns, other lines are written once the writer gets
+ * to them.
+ * Each subsystem has its own level, which can be changed while logging.
  */
 class Logger {
  public:
@@ -109,38 +145,98 @@ class Logger {
     D = 40
   };
 
-  Logger(std::ostream &_stream, level_t _level)
-      : target_(_stream), current_(_level) {
-    start_ = std::chrono::system_clock::now();
-    const auto time = std::chrono::system_clock::to_time_t(start_);
-    v() << "Log start: " << std::ctime(&time);
-  }
+  enum subsystem_t : uint8_t {
+    GENERAL,
+    PARSER,
+    CACHE,
+    SCHEDULER,
+    TRUNKS,
+    VCS,
+    SUBSYSTEMS
+  };
 
-  std::ostream& operator()(level_t _log_level) {
-    if (_log_level <= current_) {
-      auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start_);
-      std::string loglevel;
-      switch (_log_level) {
-        case W: loglevel = "WARN"; break;
-        case I: loglevel = "INFO"; break;
-        case V: loglevel = "VERB"; break;
-        case D: loglevel = "DBUG"; break;
-      }
-      return target_ << '[' << std::setw(10) << diff.count() << "] " << loglevel << " ";
-    }
-    return null_;
+  Logger(std::ostream &_stream, level_t _level);
+  ~Logger();
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  bool enabled(level_t _level, subsystem_t _subsystem = GENERAL) const {
+    return _level <= levels_[_subsystem].load(std::memory_order_relaxed);
   }
 
-  std::ostream& w() { return this->operator()(W); }
-  std::ostream& i() { return this->operator()(I); }
-  std::ostream& v() { return this->operator()(V); }
-  std::ostream& d() { return this->operator()(D); }
+  level_t level(subsystem_t _subsystem = GENERAL) const { return levels_[_subsystem].load(); }
+
+  /** Sets the level of every subsystem. */
+  void setLevel(level_t _level);
+  void setLevel(subsystem_t _subsystem, level_t _level);
+
+  /**
+   * Applies comma separated levels, "<level>" for every subsystem or "<subsystem>=<level>" for one of them, e.g.
+   * "warn,scheduler=debug". Levels are warn, info, verbose or debug, subsystems general, parser, cache, scheduler,
+   * trunks or vcs.
+   */
+  void configure(const std::string &_levels);
+
+  /** Stream to format a line into, until commit is called by the same thread. Use enabled to skip filtered lines. */
+  std::ostream& begin();
+
+  /** Queues the line formatted since begin, waits for it to be written if it's a warning. */
+  void commit(level_t _level, subsystem_t _subsystem = GENERAL);
+
+  /** Waits until every line committed before the call is written to the target stream. */
+  void flush();
 
  private:
-  std::ofstream null_;
+  struct entry_t {
+    std::chrono::system_clock::time_point time_;
+    level_t level_;
+    subsystem_t subsystem_;
+    std::string text_;
+  };
+
+  /** Single producer, single consumer queue of the lines of a thread. */
+  struct ring_t {
+    static constexpr size_t CAPACITY = 256;
+
+    entry_t entries_[CAPACITY];
+
+    /** Written by the writer thread only. */
+    std::atomic<size_t> head_ {0};
+
+    /** Written by the logging thread only. */
+    std::atomic<size_t> tail_ {0};
+  };
+
   std::ostream& target_;
-  level_t current_;
+  std::atomic<level_t> levels_[SUBSYSTEMS];
   std::chrono::system_clock::time_point start_;
+
+  /** Identifies the rings of this logger in the threads it is used from. */
+  uint64_t id_ = nextId_++;
+  static std::atomic<uint64_t> nextId_;
+
+  std::mutex ringsMutex_;
+  std::vector<std::unique_ptr<ring_t>> rings_;
+
+  /** Lines pushed to a ring, and lines written to the target, guarded by mutex_. */
+  std::atomic<uint64_t> committed_ {0};
+  uint64_t written_ = 0;
+
+  /** Set by the first line committed since the writer last drained the rings, which wakes it. */
+  std::atomic<bool> signaled_ {false};
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool requested_ = false;
+  bool stopping_ = false;
+  std::thread writer_;
+
+  ring_t& ring();
+  void wake();
+  void write();
+  size_t drain(std::vector<entry_t> &_batch);
 };
 
 }  // namespace brief
@@ -0,0 +1,95 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace brief {
+
+/**
+ * Finds the first of a list of patterns fully matching URIs.
+ * Patterns are indexed by their literal prefix ("git://", "https://github.com/"...) in a trie, so a URI is only
+ * matched against the patterns it starts with the prefix of, and the ones without prefix. Patterns without any
+ * regex syntax are compared as strings. Results are memoized per URI, in shards emptied once they hold CAPACITY
+ * results, and forgotten when patterns are added or the matcher is copied.
+ * Matching is thread safe, adding patterns isn't.
+ */
+class UriMatcher {
+ public:
+  static constexpr size_t NONE = static_cast<size_t>(-1);
+  static constexpr size_t SHARDS = 8;
+  static constexpr size_t CAPACITY = 1024;
+
+  /** Adds an ECMAScript pattern, returns its index. */
+  size_t add(const std::string &_pattern);
+
+  /** Adds a compiled pattern, its prefix is unknown so it is tried for every URI. */
+  size_t add(const std::regex &_pattern);
+
+  /** Index of the first pattern added fully matching *_uri*, NONE if none. */
+  size_t match(const std::string &_uri) const;
+
+  size_t size() const { return patterns_.size(); }
+
+  /** Longest literal prefix of the strings matching *_pattern*, *_literal* is set if the prefix is the pattern. */
+  static std::string prefix(const std::string &_pattern, bool &_literal);
+
+ private:
+  struct node_t {
+    std::unordered_map<char, size_t> children_;
+
+    /** Patterns whose prefix ends here. */
+    std::vector<size_t> patterns_;
+  };
+
+  struct pattern_t {
+    std::regex regex_;
+
+    /** Set if the pattern is a plain string. */
+    bool literal_;
+    std::string text_;
+  };
+
+  struct shard_t {
+    shard_t() = default;
+    shard_t(const shard_t &) {}
+    shard_t &operator=(const shard_t &) {
+      results_.clear();
+      return *this;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, size_t> results_;
+  };
+
+  std::vector<node_t> nodes_ {1};
+  std::vector<pattern_t> patterns_;
+  mutable shard_t memo_[SHARDS];
+
+  void index(const std::string &_prefix, size_t _pattern);
+};
+
+}  // namespace brief
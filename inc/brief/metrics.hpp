@@ -0,0 +1,141 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * Counters, gauges and histograms of the overhead of the build system, written as JSON or in the text format of
+ * Prometheus, at the end of a run or whenever asked to.
+ * Metrics are registered once by name and live as long as the registry, recording never locks. Counters and
+ * histograms are sharded by thread so that threads recording at once don't share cache lines, shards are summed
+ * when written.
+ */
+class Metrics {
+ public:
+  static constexpr size_t SHARDS = 8;
+
+  class Counter {
+   public:
+    void add(uint64_t _delta = 1) { shards_[shard()].value_.fetch_add(_delta, std::memory_order_relaxed); }
+    uint64_t value() const;
+
+   private:
+    struct shard_t {
+      std::atomic<uint64_t> value_ {0};
+      char padding_[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    shard_t shards_[SHARDS];
+  };
+
+  class Gauge {
+   public:
+    void set(int64_t _value) { value_.store(_value, std::memory_order_relaxed); }
+    void add(int64_t _delta) { value_.fetch_add(_delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<int64_t> value_ {0};
+  };
+
+  /**
+   * Counts values in log-linear buckets, as HDR histograms do: each power of two is split in 16 buckets, so values
+   * up to 32 are exact and the others within 1/16.
+   */
+  class Histogram {
+   public:
+    static constexpr size_t BUCKETS = 976;
+
+    struct snapshot_t {
+      uint64_t count_ = 0, sum_ = 0, min_ = 0, max_ = 0;
+      std::vector<uint64_t> buckets_;
+
+      /** Highest value equivalent to the one at quantile *_quantile* (0 to 1), 0 if empty. */
+      uint64_t percentile(double _quantile) const;
+    };
+
+    Histogram();
+
+    void record(uint64_t _value);
+    snapshot_t snapshot() const;
+
+    static size_t bucket(uint64_t _value);
+    static uint64_t lowest(size_t _bucket);
+    static uint64_t highest(size_t _bucket);
+
+   private:
+    struct shard_t {
+      std::atomic<uint64_t> buckets_[BUCKETS];
+      std::atomic<uint64_t> sum_;
+      char padding_[64];
+    };
+
+    std::unique_ptr<shard_t[]> shards_;
+    std::atomic<uint64_t> min_ {UINT64_MAX};
+    std::atomic<uint64_t> max_ {0};
+  };
+
+  /** Registers a metric or returns the one registered with the same name. Names are the ones of Prometheus, their
+   * unit as suffix (brief_parse_duration_microseconds, brief_parsed_bytes_total...). */
+  Counter& counter(const std::string &_name, const std::string &_help);
+  Gauge& gauge(const std::string &_name, const std::string &_help);
+  Histogram& histogram(const std::string &_name, const std::string &_help);
+
+  void writeJson(std::ostream &_dst) const;
+
+  /** Histograms are written as summaries, with their 0.5, 0.9 and 0.99 quantiles. */
+  void writePrometheus(std::ostream &_dst) const;
+
+  /** Writes JSON if *_path* ends with .json, Prometheus text otherwise. */
+  void write(const boost::filesystem::path &_path) const;
+
+ private:
+  template <typename T>
+  struct metric_t {
+    std::string help_;
+    std::unique_ptr<T> metric_;
+  };
+
+  mutable std::mutex mutex_;
+  std::map<std::string, metric_t<Counter>> counters_;
+  std::map<std::string, metric_t<Gauge>> gauges_;
+  std::map<std::string, metric_t<Histogram>> histograms_;
+
+  /** Shard of the calling thread. */
+  static size_t shard();
+
+  template <typename T>
+  static T& add(std::map<std::string, metric_t<T>> &_metrics, const std::string &_name, const std::string &_help);
+};
+
+}  // namespace brief
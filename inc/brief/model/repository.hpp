@@ -32,7 +32,7 @@
 
 namespace brief {
 
-#define BRIEF_SCHEMA_VERSION 1
+#define BRIEF_SCHEMA_VERSION 7
 
 /** Used to point to a state of the repo (a combination of revision/branch/tag)
  * If you don't provide custom tags, we'll try to use the ones on the repo. */
@@ -95,7 +95,8 @@ class Repository {
   /** Estimated in KiB, on a 4k sector disk */
   uint32_t buildSize_ = 0;
 
-  /** Estimated in seconds, relative to musl compile time on same machine */
+  /** Estimated in seconds, relative to musl compile time on same machine
+   * Replaced on configure by the wall time of the last successful build, if any. */
   float buildTime_ = 0;
 
   /** List of tasks needed to build everything */
@@ -54,14 +54,18 @@ class Dependency {
      * For example you could depend on a "debug" flavor, or "filesystem" of boost
      * (Although i'd recommend splitting boost libs in a task for each, instead of a mega-task, but both could work) */
     std::vector<std::string> require_;
+
+    /** Repository exporting the task, fetched into the trunks if the task isn't installed yet. */
+    std::string url_;
 };
 
 #define Dependency_PROPERTIES \
-  (4, ( \
+  (5, ( \
     (std::string, name_, "name"), \
     (std::string, tag_, "tag"), \
     (bool, staticLink_, "staticLink"), \
-    (std::vector<std::string>, require_, "require")) \
+    (std::vector<std::string>, require_, "require"), \
+    (std::string, url_, "url")) \
   )
 
 BRIEF_MSGPACK_INTERNAL(Dependency, Dependency_PROPERTIES)
@@ -185,8 +189,24 @@ class Task {
     NONE, SIZE, SPEED
   } optimize_ = optimisation_t::NONE;
 
+  /** Lets the toolchain precompile the headers included by most sources, and use them for every source.
+   * Opt-in as it might change sources semantics, refer to toolchain documentation. */
+  bool precompileHeaders_ = false;
+
+  /** Lets the toolchain compile sources in batches of about this many files (unity builds), 0 to disable.
+   * Opt-in as sources are no longer isolated from each other, refer to toolchain documentation. */
+  uint32_t unityBatch_ = 0;
+
+  /** Same as unityBatch, but targets a size in bytes of sources per batch, preferred if both are set. */
+  uint32_t unityBatchBytes_ = 0;
+
+  /** Expected peak memory in MiB of the heaviest jobs building this task (LTO links, template heavy sources...).
+   * Used to limit parallel jobs against the memory budget until a build measured them, 0 if unknown. */
+  uint32_t jobMemory_ = 0;
+
   /** Used by the most toolchains to build or install this task
-   * You can use wildcards, * for any file in this directory, ** for any file in this directory and subdirectories */
+   * You can use wildcards, * for any file in this directory, ** for any file in this directory and subdirectories
+   * Like include dirs and symbols, can reference variables as ${name} (symbols, constants, or prefix::name). */
   std::vector<std::string> sources_;
 
   /** Point to a list of directories in which the compiler should search when using
@@ -230,7 +250,7 @@ BRIEF_JSON_ENUM_INTERNAL(Task::optimisation_t, Task_optimisation_t_VALUES)
 BRIEF_MSGPACK_ENUM_INTERNAL(Task::optimisation_t, Task_optimisation_t_VALUES)
 
 #define Task_PROPERTIES \
-  (17, ( \
+  (21, ( \
     (std::string, inherits_, "inherits"), \
     (Task::type_t, type_, "type"), \
     (TaskFilters, filters_, "filters"), \
@@ -243,6 +263,10 @@ BRIEF_MSGPACK_ENUM_INTERNAL(Task::optimisation_t, Task_optimisation_t_VALUES)
     (std::vector<std::string>, toolchainFlags_, "toolchainFlags"), \
     (std::string, standard_, "standard"), \
     (Task::optimisation_t, optimize_, "optimize"), \
+    (bool, precompileHeaders_, "precompileHeaders"), \
+    (uint32_t, unityBatch_, "unityBatch"), \
+    (uint32_t, unityBatchBytes_, "unityBatchBytes"), \
+    (uint32_t, jobMemory_, "jobMemory"), \
     (std::vector<std::string>, sources_, "sources"), \
     (std::vector<std::string>, includeDirs_, "includeDirs"), \
     (std::vector<std::string>, headers_, "headers"), \
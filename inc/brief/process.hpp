@@ -0,0 +1,105 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace brief {
+
+/** Outcome of a subprocess, status being 128 + signal number if it was killed (like shells do), or -1 if it couldn't
+ * be waited for, the error then ending the output. */
+struct process_result_t {
+  int status_ = -1;
+  std::string output_;
+
+  /** Peak resident memory, in KiB. */
+  uint64_t peakMemory_ = 0;
+};
+
+/**
+ * Launches toolchains subprocesses (compilers, linkers...) without forking the whole brief process.
+ * Processes are started with posix_spawn (vfork semantics), their stdout and stderr being merged into a pipe.
+ * A single thread waits on every pipe and on process exits (through pidfd when available) with epoll,
+ * so hundreds of concurrent processes don't need a thread each.
+ */
+class Spawner {
+ public:
+  using Callback = std::function<void(const process_result_t &_result)>;
+
+  /** Command lines longer than this are passed through a response file (@file), if allowed. */
+  static constexpr size_t RESPONSE_FILE_THRESHOLD = 128 * 1024;
+
+  explicit Spawner(size_t _responseFileThreshold = RESPONSE_FILE_THRESHOLD);
+  ~Spawner();
+
+  /** Overrides an environment variable for processes spawned from now on. */
+  void setEnv(const std::string &_name, const std::string &_value);
+
+  /** Launches a process, *_cb* is called from the event loop thread once it exited and its output is read.
+   * Throws if the process can't be started or waited for. */
+  void spawn(const std::vector<std::string> &_args, Callback _cb, bool _responseFile = true);
+
+  /** Launches a process and waits for its result, must not be called from a spawn callback. */
+  process_result_t run(const std::vector<std::string> &_args, bool _responseFile = true);
+
+  /** Waits for every running process to finish. */
+  void wait();
+
+  size_t running() const;
+
+ private:
+  struct job_t;
+  struct env_t;
+
+  size_t responseFileThreshold_;
+  int epoll_ = -1, wakeup_ = -1;
+  std::thread loop_;
+  bool stopping_ = false;
+
+  mutable std::mutex mutex_;
+  std::condition_variable idle_;
+  uint64_t nextId_ = 1;
+  size_t running_ = 0;
+  std::unordered_map<uint64_t, std::unique_ptr<job_t>> jobs_;
+
+  /** Set once the event loop failed, processes can't be waited for anymore. */
+  std::string failure_;
+
+  /** Environment of spawned processes, only rebuilt when an override changes. */
+  std::unordered_map<std::string, std::string> envOverrides_;
+  std::shared_ptr<env_t> env_;
+
+  std::shared_ptr<env_t> environment();
+  void loop();
+
+  /** Stops waiting for processes, killing the running ones and completing their jobs with *_error*. */
+  void fail(const std::string &_error);
+};
+
+}  // namespace brief
@@ -0,0 +1,198 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "brief/metrics.hpp"
+
+namespace brief {
+
+class BinaryLog;
+class BuildState;
+class Jobserver;
+class Logger;
+class Tracer;
+
+/**
+ * Runs build actions in parallel, each one as soon as the actions it depends on are done.
+ * Toolchains plan tasks as graphs of actions instead of building them in one go, so that a task can compile
+ * against the headers of its dependencies while they are still linking.
+ * Actions are named uniquely and stably across builds, the duration and peak memory of the ones that did some work
+ * are recorded in the BuildState, if any. Among ready actions, the ones with the longest path of known durations
+ * ahead run first.
+ * Actions expected to use memory (from their history, the one of their class, or a hint) are only started if they
+ * fit in the memory budget and the available memory, other actions keep running meanwhile.
+ * With a jobserver, each action running beside the first one holds a token, so that a process tree shares its jobs.
+ */
+class Scheduler {
+ public:
+  using id_t = size_t;
+
+  /** Returned by worker() off the workers of a scheduler. */
+  static constexpr size_t NO_WORKER = SIZE_MAX;
+
+  /** What an action used, recorded to estimate its next runs. */
+  struct usage_t {
+    /** Peak resident memory in KiB, 0 if unknown. */
+    uint64_t peakMemory_ = 0;
+
+    /** Set when the action found its outputs up to date, its measures are then not recorded. */
+    bool upToDate_ = false;
+  };
+
+  using Done = std::function<void(std::exception_ptr _error, const usage_t &_usage)>;
+  using Run = std::function<void()>;
+  using RunAsync = std::function<void(Done _done)>;
+
+  /** At most *_jobs* actions run at once, defaults to the hardware concurrency. */
+  explicit Scheduler(Logger &_logger, size_t _jobs = 0, BuildState *_state = nullptr);
+
+  /** Adds an action run on a worker thread, failing if it throws. */
+  id_t add(const std::string &_name, Run _run, const std::vector<id_t> &_deps = {});
+
+  /** Adds an action that releases its worker once started (to wait on a subprocess for example),
+   * it still counts as running until *_done* is called, from any thread. */
+  id_t addAsync(const std::string &_name, RunAsync _run, const std::vector<id_t> &_deps = {});
+
+  /** Adds an action doing nothing, that other actions can depend on to wait for a group of actions. */
+  id_t milestone(const std::string &_name, const std::vector<id_t> &_deps = {});
+
+  /** Sets the class of an action (compile, link...), and the peak memory in KiB it is expected to use if it
+   * was never measured. Actions of a same class are expected to use as much memory on average. */
+  void classify(id_t _id, const std::string &_class, uint64_t _memoryHint = 0);
+
+  /** Limits the sum of the expected memory of running actions, in KiB, 0 only limits to the available memory.
+   * An action expecting more than the budget still runs, alone. */
+  void setMemoryBudget(uint64_t _budget) { memoryBudget_ = _budget; }
+
+  /** Shares jobs with other processes, the scheduler still runs at most jobs() actions at once. */
+  void setJobserver(Jobserver *_jobserver) { jobserver_ = _jobserver; }
+
+  /** Traces every action on the worker that started it, and counts the ones found up to date. */
+  void setTracer(Tracer *_tracer) { tracer_ = _tracer; }
+
+  /** Logs the start and completion of every action, with the state of the queue. */
+  void setBinaryLog(BinaryLog *_binlog) { binlog_ = _binlog; }
+
+  /** Records action durations and outcomes, and the depth of the queue, in *_metrics*. */
+  void setMetrics(Metrics &_metrics);
+
+  /** Runs every action, throws after running actions are done if one of them failed.
+   * A successful run ends the build in the BuildState, with its wall time. */
+  void run();
+
+  /** Lets an action running on the calling thread report what it used, asynchronous ones pass it to done. */
+  static void report(const usage_t &_usage);
+
+  /** Index of the worker running on the calling thread, below jobs(), for actions to use per worker resources. */
+  static size_t worker();
+
+  size_t jobs() const { return jobs_; }
+
+ private:
+  struct action_t {
+    std::string name_;
+    Run run_;
+    RunAsync async_;
+    std::vector<id_t> dependents_;
+    size_t pending_ = 0;
+    std::string class_;
+    uint64_t memoryHint_ = 0;
+
+    /** Expected peak memory in KiB, reserved from the budget while running. */
+    uint64_t memory_ = 0;
+    bool deferred_ = false;
+
+    /** Estimated duration of the longest path from the start of this action to the end of the build. */
+    std::chrono::microseconds path_ {0};
+    std::chrono::steady_clock::time_point start_;
+    int thread_ = 0;
+  };
+
+  /** Metrics recorded, null without setMetrics. */
+  struct instruments_t {
+    Metrics::Counter *hits_ = nullptr, *misses_ = nullptr, *failures_ = nullptr;
+    Metrics::Histogram *durations_ = nullptr;
+    Metrics::Gauge *ready_ = nullptr, *running_ = nullptr;
+  };
+
+  Logger &logger_;
+  size_t jobs_;
+  BuildState *state_;
+  uint64_t memoryBudget_ = 0;
+  Jobserver *jobserver_ = nullptr;
+  Tracer *tracer_ = nullptr;
+  BinaryLog *binlog_ = nullptr;
+  instruments_t instruments_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<action_t> actions_;
+  std::vector<id_t> ready_;  // Heap on path_
+  size_t running_ = 0, done_ = 0;
+  uint64_t reserved_ = 0, memoryLimit_ = 0;
+
+  /** Memory available in KiB, 0 if unknown, and when it was sampled in steady clock ticks, used without *mutex_*. */
+  std::atomic<uint64_t> available_ {0};
+  std::atomic<int64_t> sampled_ {0};
+  size_t tokens_ = 0;
+  bool acquiring_ = false, jobserverFailed_ = false;
+  std::exception_ptr error_;
+
+  id_t add(action_t &&_action, const std::vector<id_t> &_deps);
+  void work(size_t _worker);
+
+  /** Estimates critical paths from the recorded durations, unknown actions taking the average duration.
+   * Also estimates the memory of actions. */
+  void estimate();
+
+  /** Picks the most urgent ready action that fits in memory, *mutex_* being locked. */
+  bool admit(id_t &_id);
+
+  /** Refreshes *available_* if its sample is too old, *mutex_* not being locked. */
+  void sampleMemory();
+
+  /** Actions that can run at once, the implicit job plus the jobserver tokens held. */
+  size_t slots() const;
+
+  /** Marks an action as done, *mutex_* being locked. */
+  void complete(id_t _id, std::exception_ptr _error, const usage_t &_usage);
+
+  /** Readies the dependents of a done action, milestones being done right away. */
+  void release(id_t _id);
+
+  /** Orders ready actions by critical path, then by order of addition. */
+  bool lessUrgent(id_t _a, id_t _b) const;
+  void push(id_t _id);
+
+  /** Records the depth of the queue, *mutex_* being locked. */
+  void measureQueue();
+};
+
+}  // namespace brief
@@ -0,0 +1,89 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace brief {
+
+class Context;
+class Repository;
+class Task;
+class Template;
+
+/**
+ * Variables visible from the strings of a task, in order: the symbols of the task, the constants of its repo,
+ * the variables registered in the context, then the prefix callbacks (for "prefix::name" variables).
+ * Layers are looked up in place without copying them, results of prefix callbacks are memoized.
+ * Symbols and constants can reference other variables, they are expanded once per scope and their expansion is
+ * reused until a registered variable it used is registered again.
+ * Built once per task, the context, repo and task must outlive it and the repo and task must not change.
+ * Not thread safe.
+ */
+class Scope {
+ public:
+  Scope(Context &_ctx, const Repository &_repo, const Task &_task);
+
+  /** Preprocessed value of a variable, throws if unknown or if its definition references itself. */
+  std::string lookup(const std::string &_name);
+
+  /** Expands the variables referenced by a string, see Template. */
+  std::string expand(const std::string &_source);
+
+  const Repository &repo() const { return repo_; }
+  const Task &task() const { return task_; }
+
+ private:
+  using versions_t = std::vector<std::pair<std::string, uint64_t>>;
+
+  /** A variable being expanded, and the registered variables it used so far. */
+  struct frame_t {
+    std::string name_;
+    versions_t registered_;
+  };
+
+  /** An expanded variable, valid as long as the registered variables it used weren't registered again. */
+  struct value_t {
+    std::string value_;
+    versions_t registered_;
+  };
+
+  Context &ctx_;
+  const Repository &repo_;
+  const Task &task_;
+  std::unordered_map<std::string, value_t> values_;
+  std::unordered_map<std::string, std::string> prefixed_;
+  std::vector<frame_t> expanding_;
+
+  void expand(const Template &_template, std::string &_dest);
+
+  /** Appends the value of a variable. */
+  void append(const std::string &_name, std::string &_dest);
+
+  /** Makes the variable being expanded, if any, depend on registered variables. */
+  void depend(const versions_t &_registered);
+  bool valid(const value_t &_value) const;
+};
+
+}  // namespace brief
@@ -0,0 +1,133 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "brief/msgpack.hpp"
+
+namespace brief {
+
+/** A file content as it was last hashed. */
+class FileState {
+ public:
+  int64_t modified_ = 0;
+  uint64_t size_ = 0;
+  uint64_t hash_ = 0;
+};
+
+#define FileState_PROPERTIES \
+  (3, ( \
+    (int64_t, modified_, "modified"), \
+    (uint64_t, size_, "size"), \
+    (uint64_t, hash_, "hash")) \
+  )
+
+BRIEF_MSGPACK_INTERNAL(FileState, FileState_PROPERTIES)
+
+/** Last successful run of an action. */
+class ActionState {
+ public:
+  /** Fingerprint of the command and of the content of every input. */
+  uint64_t inputs_ = 0;
+
+  /** Fingerprint of the content of every output. */
+  uint64_t outputs_ = 0;
+
+  /** Wall time, in microseconds. */
+  uint64_t duration_ = 0;
+
+  /** Peak resident memory, in KiB, 0 if unknown. */
+  uint64_t peakMemory_ = 0;
+
+  /** Number of the last build that planned this action, see BuildState::finish. */
+  uint64_t build_ = 0;
+};
+
+#define ActionState_PROPERTIES \
+  (5, ( \
+    (uint64_t, inputs_, "inputs"), \
+    (uint64_t, outputs_, "outputs"), \
+    (uint64_t, duration_, "duration"), \
+    (uint64_t, peakMemory_, "peakMemory"), \
+    (uint64_t, build_, "build")) \
+  )
+
+BRIEF_MSGPACK_INTERNAL(ActionState, ActionState_PROPERTIES)
+
+/**
+ * What the previous builds of a repo produced, persisted in its output directory.
+ * Actions are outdated when the content of their inputs changed, not their timestamp: an action rewriting an
+ * identical output (a comment-only change, a regenerated header) doesn't invalidate the actions using it.
+ * Files are only rehashed when their timestamp or size changed. Thread safe.
+ * Actions no build planned for EXPIRY builds are forgotten, they are usually the ones of deleted sources. Waiting a
+ * few builds keeps the actions of the tasks and flavors built in turn.
+ */
+class BuildState {
+ public:
+  static constexpr auto FILENAME = ".state";
+  static constexpr uint64_t EXPIRY = 8;
+
+  /** Starts from an empty state if the file is missing, obsolete or unreadable. */
+  void load(const boost::filesystem::path &_path);
+  void save(const boost::filesystem::path &_path) const;
+
+  /** Fingerprint of the content of a file, 0 if it doesn't exist. */
+  uint64_t hash(const boost::filesystem::path &_file);
+
+  /** Fingerprint of the names and contents of files. */
+  uint64_t hash(const std::vector<boost::filesystem::path> &_files);
+
+  /** Checks the action last ran with the same *_inputs* fingerprint and its outputs weren't modified since. */
+  bool upToDate(const std::string &_action, uint64_t _inputs, const std::vector<boost::filesystem::path> &_outputs);
+
+  /** Records a successful run, returns false if its outputs are identical to the ones of the previous run. */
+  bool record(const std::string &_action, uint64_t _inputs, const std::vector<boost::filesystem::path> &_outputs);
+
+  /** Records the measures of a successful run. */
+  void measure(const std::string &_action, std::chrono::microseconds _duration, uint64_t _peakMemory);
+
+  /** Last successful run of an action, zeroed if it never ran. */
+  ActionState action(const std::string &_action) const;
+
+  /** Ends a successful build that planned *_actions*, which took *_duration* of wall time. Forgets expired actions. */
+  void finish(const std::vector<std::string> &_actions, std::chrono::microseconds _duration);
+
+  /** Wall time of the last successful build, 0 if none. */
+  std::chrono::microseconds lastDuration() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, FileState> files_;
+  std::unordered_map<std::string, ActionState> actions_;
+
+  /** Number of the current build, the count of successful builds. */
+  uint64_t builds_ = 0;
+  uint64_t lastDuration_ = 0;
+};
+
+}  // namespace brief
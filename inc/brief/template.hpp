@@ -0,0 +1,82 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace brief {
+
+/**
+ * A string referencing variables as "${name}", "$$" standing for a single "$".
+ * Parsed once into literal and variable segments, so that expanding it doesn't scan it again.
+ */
+class Template {
+ public:
+  struct segment_t {
+    bool variable_;
+
+    /** Literal text, or name of the variable. */
+    std::string text_;
+  };
+
+  /** Throws on unterminated or empty variable references. */
+  explicit Template(const std::string &_source);
+
+  const std::vector<segment_t> &segments() const { return segments_; }
+
+  /** Whether the template has no variable, it is then its single literal segment (if not empty). */
+  bool literal() const { return variables_ == 0; }
+
+  /** Size of the literal segments, a lower bound of the size of the expansion. */
+  size_t literalSize() const { return literalSize_; }
+
+ private:
+  std::vector<segment_t> segments_;
+  size_t variables_ = 0, literalSize_ = 0;
+};
+
+/**
+ * Templates compiled so far, as strings are expanded many times (once per task and flavor). Owned by the Context and
+ * shared by its threads, sharded by string so that threads rarely wait for each other. A shard is emptied once it
+ * holds CAPACITY templates, the ones in use being kept alive by their users. Thread safe.
+ */
+class TemplateCache {
+ public:
+  static constexpr size_t SHARDS = 16;
+  static constexpr size_t CAPACITY = 1024;
+
+  /** Compiled form of *_source*, parsed on the first request. Throws as Template does. */
+  std::shared_ptr<const Template> get(const std::string &_source);
+
+ private:
+  struct shard_t {
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Template>> templates_;
+  };
+
+  shard_t shards_[SHARDS];
+};
+
+}  // namespace brief
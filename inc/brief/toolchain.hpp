@@ -24,15 +24,22 @@
 #include <string>
 #include <vector>
 
+#include <boost/filesystem/path.hpp>
+
+#include "brief/scheduler.hpp"
+
 namespace brief {
 
 class Context;
+class Task;
 
 /**
  * Implements how to treat a set of brief::tasks.
  * Library tasks usually declares sources and headers.
  * Application tasks usually declares sources.
- * Must be thread safe, there might be multiple instances of the same toolchain running in parallel.
+ * Toolchains are created once per process and shared by every thread, so their setup (probing compilers...) is done
+ * once. They must be thread safe, unless they aren't reentrant: each scheduler worker then gets its own instance, that
+ * the actions they plan must get from Context::getToolchain when they run.
  * Task inputed to toolchains are already merged, you should have to work only with:
  *    - toolchain_flags
  *    - standard
@@ -48,9 +55,30 @@ class Toolchain {
  public:
   using Factory = std::function<std::shared_ptr<Toolchain>(Context&)>;
 
-  virtual void build(const Task &_task, const std::vector<std::string> &_flavors) = 0;
-  virtual void test(const Task &_task) = 0;
-  virtual void install(const Task &_task) = 0;
+  virtual ~Toolchain() {}
+
+  /** Whether an instance can be used by several threads at once. */
+  virtual bool reentrant() const { return true; }
+
+  /** What a planned task exposes to the tasks depending on it. */
+  struct plan_t {
+    /** Done once headers and generated sources are ready, dependents can compile. */
+    Scheduler::id_t interface_;
+
+    /** Done once every output is ready, dependents can link. */
+    Scheduler::id_t output_;
+
+    /** Absolute include dirs and libraries to build against this task, including the ones of its dependencies. */
+    std::vector<boost::filesystem::path> includeDirs_;
+    std::vector<boost::filesystem::path> libraries_;
+  };
+
+  /** Adds the actions building the task named *_name* to *_scheduler*, after the plans of its dependencies.
+   * Outputs are expected in Builder::outputDir(_name, _flavors). */
+  virtual plan_t plan(Scheduler &_scheduler, const std::string &_name, const Task &_task,
+                      const std::vector<std::string> &_flavors, const std::vector<plan_t> &_dependencies) = 0;
+  virtual void test(const std::string &_name, const Task &_task) = 0;
+  virtual void install(const std::string &_name, const Task &_task) = 0;
 };
 
 }  // namespace brief
@@ -0,0 +1,73 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "brief/toolchain.hpp"
+
+namespace brief {
+
+/**
+ * Builds C and C++ tasks with clang.
+ * Translation units are compiled in-process, on scheduler threads that each drive their own compiler instance,
+ * this avoids a fork/exec and a driver startup per source file. Linking is done by clang++ or ar subprocesses,
+ * launched through the context Spawner. Sources start compiling as soon as the headers of the dependencies are
+ * ready, only the link waits for their libraries. Units and links are only redone when the content of their inputs
+ * changed (see BuildState), an identical object or library doesn't trigger relinks.
+ *    - toolchainFlags: appended to the compiler command line
+ *    - standard: passed as -std=
+ *    - sources: compiled as C or C++ depending on their extension
+ *    - includeDirs: passed as -I, to this task and the ones depending on it
+ *    - symbols: passed as -D
+ *    - optimize: none is -O0, size is -Os and speed is -O2
+ *    - precompileHeaders: headers included by at least half of the sources of the most common language are
+ *      precompiled once per task and flavors, then implicitly included by each of those sources
+ *    - unityBatch, unityBatchBytes: sources of a same language are compiled in generated batches including them,
+ *      sources edited since their batch was built are compiled alone until the next clean build
+ *    - jobMemory: expected memory of each compile and link, until they are measured
+ * Application tasks are linked into an executable, with the libraries of their dependencies,
+ * library tasks are archived into a static library.
+ * The "debug" flavor adds debug info.
+ */
+class ClangToolchain : public Toolchain {
+ public:
+  static constexpr auto NAME = "clang";
+
+  explicit ClangToolchain(Context &_ctx);
+
+  plan_t plan(Scheduler &_scheduler, const std::string &_name, const Task &_task,
+              const std::vector<std::string> &_flavors, const std::vector<plan_t> &_dependencies) override;
+  void test(const std::string &_name, const Task &_task) override;
+  void install(const std::string &_name, const Task &_task) override;
+
+ private:
+  Context &ctx_;
+  std::string clang_, clangxx_, ar_;
+
+  std::vector<std::string> compileFlags(const Task &_task, const std::vector<std::string> &_flavors,
+                                        const std::vector<boost::filesystem::path> &_includeDirs) const;
+  std::vector<std::string> cc1Template(const std::vector<std::string> &_flags, const std::string &_extension) const;
+  void link(const std::vector<std::string> &_args, Scheduler::Done _done) const;
+};
+
+}  // namespace brief
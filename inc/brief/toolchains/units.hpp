@@ -0,0 +1,69 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+class Logger;
+class Task;
+
+/** A source compiled into an object, and the dependency file the compiler writes beside it. */
+struct unit_t {
+  boost::filesystem::path source_, object_, depfile_;
+};
+
+/** Splits units in batches, the end of a batch being decided by each unit alone, from a hash of its path relative to
+ * *_root* (and its size if targeting bytes). Adding or removing a source thus only reshapes the batch it belongs to,
+ * unless that batch reaches the cap of 4 times Task::unityBatch_ units (or Task::unityBatchBytes_ bytes). */
+std::vector<std::vector<const unit_t*>> chunk(const std::vector<const unit_t*> &_units, const Task &_task,
+                                              const boost::filesystem::path &_root);
+
+/**
+ * Replaces units by unity batches, sources generated in the unity directory of *_output* including their members.
+ * Sources edited since their batch was built get detached and compiled alone until the next clean build. Batches are
+ * still cut and named from all their sources, so detaching one rebuilds its batch once without it, leaving the other
+ * batches as they are, and further edits of the source only rebuild it. Batches no longer in use are removed.
+ */
+std::vector<unit_t> makeBatches(Logger &_logger, const std::vector<unit_t> &_units, const Task &_task,
+                                const boost::filesystem::path &_root, const boost::filesystem::path &_output);
+
+/** Reads a make style dependency file as written by -MD, returns the prerequisites. */
+std::vector<boost::filesystem::path> readDepfile(const boost::filesystem::path &_depfile);
+
+/**
+ * Builds a header including, in order of first appearance, the headers that at least 2 units and half of them include
+ * outside of conditional blocks. Returns an empty string if there is none.
+ */
+std::string makePrelude(const std::vector<const unit_t*> &_units);
+
+/**
+ * Tells if the precompiled header *_pch* exists and was recorded with the same prelude, command line and content of
+ * the headers listed in its dependency file, as hashed in a file beside its source.
+ */
+bool isPrecompiled(const std::string &_prelude, const std::vector<std::string> &_cc1, const unit_t &_pch);
+
+/** Records what the precompiled header *_pch* was just generated from, for isPrecompiled. */
+void recordPrecompiled(const std::string &_prelude, const std::vector<std::string> &_cc1, const unit_t &_pch);
+
+}  // namespace brief
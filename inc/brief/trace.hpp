@@ -0,0 +1,106 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace brief {
+
+/**
+ * Records where wall time goes as Chrome trace events, viewable in chrome://tracing or Perfetto.
+ * Spans nest by thread, counters are plotted over time. Does nothing until opened. Thread safe.
+ */
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using args_t = std::vector<std::pair<std::string, std::string>>;
+
+  /** Times a scope, cheap when tracing is disabled. */
+  class Span {
+   public:
+    Span(Tracer &_tracer, const std::string &_category, const std::string &_name);
+    ~Span();
+
+    /** Annotates the span, shown when it is selected. */
+    void arg(const std::string &_name, const std::string &_value);
+
+   private:
+    Tracer &tracer_;
+    std::string category_, name_;
+    Clock::time_point start_;
+    args_t args_;
+  };
+
+  Tracer();
+
+  /** Writes recorded events, if tracing was enabled. */
+  ~Tracer();
+
+  /** Starts recording events, written to *_path* on destruction. Must be called before other threads trace. */
+  void open(const boost::filesystem::path &_path);
+  bool enabled() const { return !path_.empty(); }
+
+  /** Records a span that ran on thread *_thread*, as returned by thread(). */
+  void complete(const std::string &_category, const std::string &_name, Clock::time_point _start,
+                Clock::time_point _end, int _thread, const args_t &_args = args_t());
+
+  /** Adds *_delta* to a counter. */
+  void count(const std::string &_name, int64_t _delta = 1);
+
+  /** Identifier of the calling thread in the trace. */
+  int thread();
+
+  /** Names the calling thread in the trace. */
+  void nameThread(const std::string &_name);
+
+  /** Writes every event recorded so far, also done on destruction. */
+  void flush();
+
+ private:
+  struct event_t {
+    char phase_;
+    std::string category_, name_;
+    int64_t timestamp_, duration_;
+    int thread_;
+    args_t args_;
+  };
+
+  boost::filesystem::path path_;
+  Clock::time_point origin_;
+
+  std::mutex mutex_;
+  std::vector<event_t> events_;
+  std::map<std::thread::id, int> threads_;
+  std::map<std::string, int64_t> counters_;
+
+  int64_t since(Clock::time_point _time) const;
+  int threadLocked();
+};
+
+}  // namespace brief
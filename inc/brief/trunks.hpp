@@ -18,6 +18,13 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include "brief/model/task.hpp"
@@ -25,19 +32,111 @@
 namespace brief {
 
 class Context;
+class Repository;
+
+/** An export installed in the trunks. */
+struct installed_t {
+  std::string export_;
+  std::string tag_;
+  std::string repo_;
+
+  /** Description of the repository in its checkout. */
+  boost::filesystem::path description_;
+};
 
 /**
  * Class responsible for installing and removing repositories from the trunks directory.
+ * Installed exports are listed by an index from their name and tag to their merged task, stored in an append-only
+ * pack with the location of their description. Both files are memory mapped: has() and retreive() hash the key,
+ * probe the index and read a single task, without opening any description.
+ * The index is an open addressing hash table, rewritten and renamed over the previous one on changes, so that other
+ * processes reading the trunks meanwhile keep a consistent view. Changes made by other processes are seen by the
+ * next Trunks. Processes changing the trunks take an exclusive flock on its LOCK file, ones mapping it a shared one.
+ * Records replaced or removed stay in the pack until they make up more than half of it, it is then compacted.
+ * Thread safe.
  */
 class Trunks {
  public:
+  static constexpr auto INDEX = "index";
+  static constexpr auto PACK = "pack";
+  static constexpr auto CHECKOUTS = "checkouts";
+  static constexpr auto OBJECTS = "objects";
+  static constexpr auto LOCK = "lock";
+
   explicit Trunks(Context &_ctx);
+  ~Trunks();
 
-  void has(const Dependency &_dep);
+  /** Directory of the trunks, $BRIEF_TRUNKS or ~/.brief/trunks by default. */
+  void setRoot(const boost::filesystem::path &_root);
+  boost::filesystem::path root() const;
+
+  /** Tags are compared as they are written, an empty tag being the head installed. */
+  bool has(const Dependency &_dep);
+
+  /** Task exported at the tag of the dependency, inherited tasks merged in. Throws if it isn't installed. */
   Task retreive(const Dependency &_dep);
-  void add(...);
-  void remove(...);
-  void list(...);
+
+  /** Installs the exports of a repository checked out at *_tag*, replacing the ones installed at the same tag. */
+  void add(const Repository &_repo, const std::string &_tag, const boost::filesystem::path &_description);
+
+  /** Removes the exports of a repository installed at *_tag*. */
+  void remove(const std::string &_repo, const std::string &_tag);
+
+  std::vector<installed_t> list();
+
+  /**
+   * Installs the dependencies that aren't yet, fetched from their url, along with their own dependencies.
+   * Up to *_jobs* repositories are fetched at once: each description is parsed and installed as soon as its checkout
+   * is done, and the dependencies it brings are queued while the other fetches go on.
+   * Each upstream is fetched once in a bare repository shared by the checkouts of all its tags, shallowly unless the
+   * filters of its exports compare tags. Both are kept in the trunks, so an interrupted run resumes, installed
+   * repositories being skipped and fetched objects kept.
+   * Throws once every fetch ended if any failed.
+   */
+  void fetch(const std::vector<Dependency> &_deps, size_t _jobs = 8);
+
+ private:
+  struct mapping_t;
+
+  /** Index slot, empty if offset_ is 0. */
+  struct slot_t {
+    uint64_t hash_;
+    uint64_t offset_;
+  };
+
+  Context &ctx_;
+  boost::filesystem::path root_;
+
+  std::mutex mutex_;
+  bool opened_ = false;
+  std::unique_ptr<mapping_t> index_, pack_;
+
+  /** Maps the index and the pack if not done yet, *mutex_* being locked. */
+  void open();
+
+  /** Same, the LOCK file being locked. */
+  void map();
+
+  /** Offset of the record of an export in the pack, 0 if it isn't installed. */
+  uint64_t find(const std::string &_export, const std::string &_tag) const;
+
+  /** Reads the fields of a record before its task, returns the offset of the task. */
+  uint64_t header(uint64_t _offset, installed_t &_installed) const;
+
+  /** Rewrites the index with the records of *_slots*, compacting the pack if needed, then maps them again.
+   * The LOCK file must be exclusively locked. */
+  void rewrite(std::vector<slot_t> _slots);
+
+  /** Rewrites the pack with only the records of *_slots*, updating their offsets. */
+  void compact(std::vector<slot_t> &_slots);
+
+  std::vector<slot_t> slots() const;
+
+  /**
+   * Fetches a repository in its object store, *_store* being locked meanwhile, installs it at *_tag* and returns the
+   * dependencies of its exports.
+   */
+  std::vector<Dependency> install(const std::string &_url, const std::string &_tag, std::mutex &_store);
 };
 
 }  // namespace brief
@@ -0,0 +1,275 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "brief/binlog.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace brief {
+
+namespace {
+
+constexpr char MAGIC[8] = {'B', 'R', 'I', 'E', 'F', 'B', 'I', 'N'};
+constexpr uint32_t VERSION = 1;
+
+/** Formats registered by every log, indexed by id. */
+struct formats_t {
+  std::mutex mutex_;
+  std::vector<std::string> formats_;
+};
+
+formats_t& formats() {
+  static formats_t formats;
+  return formats;
+}
+
+template <typename T>
+void write(std::ostream &_dst, T _value) {
+  _dst.write(reinterpret_cast<const char*>(&_value), sizeof(T));
+}
+
+/** Reads a value from a chunk, false if it is truncated. */
+template <typename T>
+bool read(const char *&_src, const char *_end, T &_value) {
+  if (static_cast<size_t>(_end - _src) < sizeof(T))
+    return false;
+  std::memcpy(&_value, _src, sizeof(T));
+  _src += sizeof(T);
+  return true;
+}
+
+template <typename T>
+bool read(std::istream &_src, T &_value) {
+  return static_cast<bool>(_src.read(reinterpret_cast<char*>(&_value), sizeof(T)));
+}
+
+struct line_t {
+  uint64_t time_;
+  uint32_t thread_;
+  std::string text_;
+};
+
+/** Renders a line from the arguments recorded after its header, false if they are truncated. */
+bool render(const std::string &_format, uint8_t _count, const char *&_src, const char *_end, std::string &_text) {
+  std::vector<std::string> args;
+  for (uint8_t i = 0; i < _count; i++) {
+    char type;
+    if (!read(_src, _end, type))
+      return false;
+    std::ostringstream arg;
+    if (type == 'i') {
+      int64_t value;
+      if (!read(_src, _end, value))
+        return false;
+      arg << value;
+    } else if (type == 'u') {
+      uint64_t value;
+      if (!read(_src, _end, value))
+        return false;
+      arg << value;
+    } else if (type == 'f') {
+      double value;
+      if (!read(_src, _end, value))
+        return false;
+      arg << value;
+    } else if (type == 's') {
+      uint32_t size;
+      if (!read(_src, _end, size) || static_cast<size_t>(_end - _src) < size)
+        return false;
+      arg.write(_src, size);
+      _src += size;
+    } else {
+      throw std::runtime_error(std::string("Unknown argument type in binary log: ") + type);
+    }
+    args.push_back(arg.str());
+  }
+
+  // Arguments without placeholder are appended, placeholders without argument kept
+  size_t next = 0;
+  for (size_t i = 0; i < _format.size(); i++) {
+    if (_format[i] == '{' && i + 1 < _format.size() && _format[i + 1] == '}' && next < args.size()) {
+      _text += args[next++];
+      i++;
+    } else {
+      _text += _format[i];
+    }
+  }
+  for (; next < args.size(); next++)
+    _text += ' ' + args[next];
+  return true;
+}
+
+}  // namespace
+
+std::atomic<uint64_t> BinaryLog::nextId_ {0};
+constexpr size_t BinaryLog::BUFFER_SIZE;
+
+BinaryLog::BinaryLog() : origin_(Clock::now()) {
+}
+
+BinaryLog::~BinaryLog() {
+  if (!enabled())
+    return;
+  try {
+    flush();
+  } catch (const std::exception &) {
+    // Logging is best effort
+  }
+}
+
+void BinaryLog::open(const boost::filesystem::path &_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  file_.open(_path.string(), std::ios::binary | std::ios::trunc);
+  if (!file_)
+    throw std::runtime_error("Can't write binary log " + _path.string());
+  file_.write(MAGIC, sizeof(MAGIC));
+  brief::write(file_, VERSION);
+  formats_ = 0;
+  origin_ = Clock::now();
+  enabled_ = true;
+}
+
+uint32_t BinaryLog::format(const char *_format) {
+  formats_t &registry = formats();
+  std::lock_guard<std::mutex> lock(registry.mutex_);
+  registry.formats_.emplace_back(_format);
+  return static_cast<uint32_t>(registry.formats_.size() - 1);
+}
+
+void BinaryLog::flush() {
+  std::lock_guard<std::mutex> lock(buffersMutex_);
+  for (const auto &buffer : buffers_) {
+    std::lock_guard<std::mutex> bufferLock(buffer->mutex_);
+    write(*buffer);
+  }
+  std::lock_guard<std::mutex> fileLock(mutex_);
+  file_.flush();
+}
+
+BinaryLog::buffer_t& BinaryLog::buffer() {
+  // Logs ids are never reused, so the buffers of destroyed logs are never looked up
+  thread_local std::unordered_map<uint64_t, buffer_t*> buffers;
+  buffer_t *&buffer = buffers[id_];
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    buffers_.emplace_back(new buffer_t);
+    buffer = buffers_.back().get();
+    buffer->thread_ = static_cast<uint32_t>(buffers_.size() - 1);
+    buffer->data_.reserve(BUFFER_SIZE + 1024);
+  }
+  return *buffer;
+}
+
+void BinaryLog::write(buffer_t &_buffer) {
+  if (_buffer.data_.empty())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Lines only use formats registered before they were logged
+  {
+    formats_t &registry = formats();
+    std::lock_guard<std::mutex> formatsLock(registry.mutex_);
+    for (; formats_ < registry.formats_.size(); formats_++) {
+      const std::string &format = registry.formats_[formats_];
+      file_.put('F');
+      brief::write(file_, static_cast<uint32_t>(formats_));
+      brief::write(file_, static_cast<uint32_t>(format.size()));
+      file_.write(format.data(), format.size());
+    }
+  }
+
+  file_.put('C');
+  brief::write(file_, _buffer.thread_);
+  brief::write(file_, static_cast<uint32_t>(_buffer.data_.size()));
+  file_.write(_buffer.data_.data(), _buffer.data_.size());
+  _buffer.data_.clear();
+}
+
+void BinaryLog::decode(std::istream &_src, std::ostream &_dst) {
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  if (!_src.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) || !read(_src, version))
+    throw std::runtime_error("Not a binary log.");
+  if (version != VERSION)
+    throw std::runtime_error("Unsupported binary log version " + std::to_string(version) + ".");
+
+  std::unordered_map<uint32_t, std::string> formats;
+  std::vector<line_t> lines;
+  bool truncated = false;
+  std::string chunk;
+  char tag;
+  while (!truncated && _src.get(tag)) {
+    uint32_t id, size;
+    if (!read(_src, id) || !read(_src, size)) {
+      truncated = true;
+      break;
+    }
+    // The lines of a truncated chunk that were written are still rendered
+    chunk.resize(size);
+    if (!_src.read(&chunk[0], size)) {
+      chunk.resize(static_cast<size_t>(_src.gcount()));
+      truncated = true;
+    }
+
+    if (tag == 'F') {
+      if (!truncated)
+        formats[id] = chunk;
+      continue;
+    } else if (tag != 'C') {
+      throw std::runtime_error(std::string("Unknown record in binary log: ") + tag);
+    }
+
+    // Records of a thread
+    const char *src = chunk.data(), *end = chunk.data() + chunk.size();
+    while (src != end) {
+      uint32_t format;
+      uint8_t count;
+      line_t line;
+      line.thread_ = id;
+      if (!read(src, end, format) || !read(src, end, line.time_) || !read(src, end, count)) {
+        truncated = true;
+        break;
+      }
+      const auto found = formats.find(format);
+      if (found == formats.end())
+        throw std::runtime_error("Unknown format " + std::to_string(format) + " in binary log.");
+      if (!render(found->second, count, src, end, line.text_)) {
+        truncated = true;
+        break;
+      }
+      lines.push_back(std::move(line));
+    }
+  }
+
+  // Chunks of different threads overlap in time
+  std::stable_sort(lines.begin(), lines.end(), [](const line_t &_a, const line_t &_b) {
+    return _a.time_ < _b.time_;
+  });
+  for (const line_t &line : lines) {
+    _dst << '[' << std::setw(10) << line.time_ / 1000000 << '.' << std::setfill('0') << std::setw(3)
+         << line.time_ / 1000 % 1000 << std::setfill(' ') << "] #" << line.thread_ << ' ' << line.text_ << '\n';
+  }
+
+  if (truncated)
+    throw std::runtime_error("Binary log truncated, its last lines are missing.");
+}
+
+}  // namespace brief
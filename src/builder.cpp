@@ -16,8 +16,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <utility>
 
 #include "brief/builder.hpp"
 #include "brief/context.hpp"
@@ -27,23 +33,63 @@ namespace brief {
 namespace fs = boost::filesystem;
 
 void Builder::buildCache(const boost::filesystem::path &_repodesc, const std::vector<std::string> &_flavors) {
-  std::ifstream src(_repodesc.string());
   std::string buf;
+  {
+    Tracer::Span span(ctx_.tracer_, "configure", "Read description");
+    span.arg("path", _repodesc.string());
+    std::ifstream src(_repodesc.string());
+    src.seekg(0, std::ios::end);
+    buf.reserve(static_cast<size_t>(src.tellg()));
+    src.seekg(0, std::ios::beg);
+    buf.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+    src.close();
+  }
 
-  src.seekg(0, std::ios::end);
-  buf.reserve(static_cast<size_t>(src.tellg()));
-  src.seekg(0, std::ios::beg);
-  buf.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
-  src.close();
+  {
+    // The tokenizer is driven by the parser
+    Tracer::Span span(ctx_.tracer_, "configure", "Tokenize and parse description");
+    BRIEF_BIN(ctx_.binlog_, "Parsing {}: {} bytes", _repodesc.string(), buf.size());
+    const auto start = std::chrono::steady_clock::now();
+    Tokenizer tokenizer(std::begin(buf).base(), std::end(buf).base());
+    json<Repository>::parse(tokenizer, repo_);
+    ctx_.metrics_.histogram("brief_parse_duration_microseconds", "Time to tokenize and parse a description.").record(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    ctx_.metrics_.counter("brief_parsed_bytes_total", "Bytes of descriptions parsed.").add(buf.size());
+    BRIEF_BIN(ctx_.binlog_, "Parsed {} tasks, {} exports", repo_.tasks_.size(), repo_.exports_.size());
+  }
+  BRIEF_SV(ctx_.logger_, PARSER, "Parsed " << _repodesc << ": " << buf.size() << " bytes, " << repo_.tasks_.size()
+           << " tasks.");
+  root_ = fs::absolute(_repodesc).parent_path();
+  flavors_ = _flavors;
 
-  Tokenizer tokenizer(std::begin(buf).base(), std::end(buf).base());
+  // Prefer the time previous builds actually took to the estimate of the description
+  BuildState state;
+  state.load(root_ / std::string(OUTPUT_DIR) / BuildState::FILENAME);
+  const auto measured = std::chrono::duration_cast<std::chrono::duration<float>>(state.lastDuration());
+  if (measured.count() > 0)
+    repo_.buildTime_ = measured.count();
 
-  json<Repository>::parse(tokenizer, repo_);
+  // Dependencies found neither here nor in the trunks are fetched from their url, if any
+  std::vector<Dependency> missing;
+  for (const auto *tasks : {&repo_.tasks_, &repo_.exports_}) {
+    for (const auto &task : *tasks) {
+      for (const Dependency &dependency : task.second.dependencies_) {
+        if (!dependency.url_.empty() && repo_.tasks_.count(dependency.name_) == 0
+            && repo_.exports_.count(dependency.name_) == 0)
+          missing.push_back(dependency);
+      }
+    }
+  }
+  if (!missing.empty()) {
+    Tracer::Span span(ctx_.tracer_, "configure", "Fetch dependencies");
+    ctx_.trunks_.fetch(missing);
+  }
 
   // TODO Preprocess task and strings
   //  Remove optional task if one of their dependency isn't present, merge the others
   //  Remove disabled experimental features, pass the other in flavors
 
+  Tracer::Span span(ctx_.tracer_, "configure", "Write cache");
   const fs::path cachePath = _repodesc.string() + CACHE_SUFFIX;
   std::ofstream dst(cachePath.string());
   msgpack<int>::write(dst, BRIEF_SCHEMA_VERSION);  // brief schema version
@@ -64,14 +110,22 @@ void Builder::loadCachedDesc(const fs::path &_repodesc) {
 
   std::ifstream src(cachePath.string());
   int version;  // brief schema version
-  msgpack<int>::read(src, version);
   std::vector<std::string> flavors;  // configured flavors
-  msgpack<std::vector<std::string>>::read(src, flavors);
-
-  const bool obsolete = version != BRIEF_SCHEMA_VERSION;
-  const bool outdated = (fs::last_write_time(_repodesc) - fs::last_write_time(cachePath)) > 0;
+  bool obsolete, outdated;
+  {
+    Tracer::Span span(ctx_.tracer_, "configure", "Validate cache");
+    msgpack<int>::read(src, version);
+    msgpack<std::vector<std::string>>::read(src, flavors);
+    obsolete = version != BRIEF_SCHEMA_VERSION;
+    outdated = (fs::last_write_time(_repodesc) - fs::last_write_time(cachePath)) > 0;
+  }
+  ctx_.tracer_.count(outdated || obsolete ? "Description cache misses" : "Description cache hits");
+  if (outdated || obsolete)
+    ctx_.metrics_.counter("brief_description_cache_misses_total", "Descriptions parsed again to load them.").add();
+  else
+    ctx_.metrics_.counter("brief_description_cache_hits_total", "Descriptions loaded from their cache.").add();
   if (outdated || obsolete) {
-    BRIEF_V(ctx_.logger_, "Cache " << cachePath << " outdated or obsolete, re-configuring...");
+    BRIEF_SV(ctx_.logger_, CACHE, "Cache " << cachePath << " outdated or obsolete, re-configuring...");
     src.close();
     fs::remove(cachePath);
 
@@ -84,20 +138,87 @@ void Builder::loadCachedDesc(const fs::path &_repodesc) {
   }
 
   try {
-    BRIEF_V(ctx_.logger_, "Cache " << cachePath << " present, using it.");
+    BRIEF_SV(ctx_.logger_, CACHE, "Cache " << cachePath << " present, using it.");
+    Tracer::Span span(ctx_.tracer_, "configure", "Load cache");
+    const auto start = std::chrono::steady_clock::now();
     msgpack<Repository>::read(src, repo_);
+    ctx_.metrics_.histogram("brief_cache_load_duration_microseconds", "Time to load a description cache.").record(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
     src.close();
+    root_ = fs::absolute(_repodesc).parent_path();
+    flavors_ = flavors;
   } catch (const std::runtime_error &e) {
     fs::remove(cachePath);
     throw std::runtime_error(std::string("Can't read cache, removed it. Caused by: ") + e.what());
   }
 }
 
-void Builder::build(const std::string &_task, const std::vector<std::string> &_flavors) {
-  BRIEF_I(ctx_.logger_, "Building task " << _task << " with flavors: " << _flavors);
+/** Tasks planned so far during a build, and the toolchains that must outlive the scheduler run. */
+struct Builder::planning_t {
+  planning_t(Context &_ctx, const build_options_t &_options, BuildState &_state)
+      : scheduler_(_ctx.logger_, _options.jobs_, &_state) {
+    scheduler_.setMemoryBudget(_options.memoryBudget_);
+    scheduler_.setJobserver(_options.jobserver_);
+    if (_ctx.tracer_.enabled())
+      scheduler_.setTracer(&_ctx.tracer_);
+    if (_ctx.binlog_.enabled())
+      scheduler_.setBinaryLog(&_ctx.binlog_);
+    scheduler_.setMetrics(_ctx.metrics_);
+  }
+
+  Scheduler scheduler_;
+  std::map<std::string, Toolchain::plan_t> plans_;
+  std::set<std::string> visiting_;
+  std::vector<std::shared_ptr<Toolchain>> toolchains_;
+};
+
+void Builder::build(const std::vector<std::string> &_tasks, const std::vector<std::string> &_flavors,
+                    const build_options_t &_options) {
+  BRIEF_I(ctx_.logger_, "Building tasks " << _tasks << " with flavors: " << _flavors);
+  // Actions might read registries from workers
+  if (!ctx_.frozen())
+    ctx_.freeze();
+
+  const fs::path statePath = root_ / std::string(OUTPUT_DIR) / BuildState::FILENAME;
+  {
+    Tracer::Span span(ctx_.tracer_, "build", "Load state");
+    state_.load(statePath);
+  }
+
+  std::set<std::string> unknown(_flavors.begin(), _flavors.end());
+  planning_t planning(ctx_, _options, state_);
+  {
+    Tracer::Span span(ctx_.tracer_, "build", "Resolve dependencies");
+    for (const std::string &task : _tasks) {
+      const std::vector<std::string> flavors = knownFlavors(task, _flavors);
+      for (const std::string &flavor : flavors)
+        unknown.erase(flavor);
+      plan(planning, task, flavors);
+    }
+  }
+  if (!unknown.empty())
+    throw std::out_of_range(std::string("No flavor known as ") + *unknown.begin());
+
+  // Actions that succeeded are recorded even if the build failed
+  auto save = [this, &statePath]() {
+    Tracer::Span span(ctx_.tracer_, "build", "Save state");
+    state_.save(statePath);
+  };
+  try {
+    Tracer::Span span(ctx_.tracer_, "build", "Run actions");
+    planning.scheduler_.run();
+  } catch (...) {
+    save();
+    throw;
+  }
+  save();
+}
 
+Task Builder::merge(const std::string &_task, const std::vector<std::string> &_flavors) {
   // Merge task with active flavors
   // FIXME Cache thus merges
+  Tracer::Span span(ctx_.tracer_, "build", "Merge flavors");
+  span.arg("task", _task);
   Task merged = repo_.getTask(_task);
   std::multimap<std::string, Task> source;
   std::swap(merged.flavors_, source);
@@ -107,12 +228,86 @@ void Builder::build(const std::string &_task, const std::vector<std::string> &_f
       throw std::out_of_range(std::string("No flavor known as ") + flavor);
     merged = merged.merge(it->second);
   }
-  BRIEF_D(ctx_.logger_, "Task merged with flavors: " << merged);
 
-  // FIXME Notify trunks of the dependencies, and ask for refresh (rebuild if needed)
+  // Expanded once merged, so that flavors can override the variables used by the task
+  Scope scope(ctx_, repo_, merged);
+  std::vector<std::string> sources, includeDirs, toolchainFlags;
+  std::unordered_map<std::string, std::string> symbols;
+  merged.standard_ = scope.expand(merged.standard_);
+  for (const std::string &flag : merged.toolchainFlags_)
+    toolchainFlags.push_back(scope.expand(flag));
+  for (const std::string &source : merged.sources_)
+    sources.push_back(scope.expand(source));
+  for (const std::string &dir : merged.includeDirs_)
+    includeDirs.push_back(scope.expand(dir));
+  for (const auto &symbol : merged.symbols_)
+    symbols.emplace(symbol.first, scope.expand(symbol.second));
+  merged.sources_ = std::move(sources);
+  merged.includeDirs_ = std::move(includeDirs);
+  merged.symbols_ = std::move(symbols);
+  merged.toolchainFlags_ = std::move(toolchainFlags);
+  BRIEF_D(ctx_.logger_, "Task " << _task << " merged with flavors: " << merged);
+  return merged;
+}
+
+std::vector<std::string> Builder::knownFlavors(const std::string &_task, const std::vector<std::string> &_flavors,
+                                               const std::vector<std::string> &_required) {
+  const Task task = repo_.getTask(_task);
+  std::vector<std::string> result;
+  for (const std::vector<std::string> *flavors : {&_flavors, &_required}) {
+    for (const std::string &flavor : *flavors) {
+      if (task.flavors_.count(flavor) && std::find(result.begin(), result.end(), flavor) == result.end())
+        result.push_back(flavor);
+    }
+  }
+  return result;
+}
+
+Toolchain::plan_t Builder::plan(planning_t &_planning, const std::string &_task,
+                                const std::vector<std::string> &_flavors) {
+  std::string key = _task;
+  for (const std::string &flavor : _flavors)
+    key += ":" + flavor;
+  auto planned = _planning.plans_.find(key);
+  if (planned != _planning.plans_.end())
+    return planned->second;
+  if (!_planning.visiting_.insert(key).second)
+    throw std::runtime_error("Dependency cycle through task " + _task);
+
+  Tracer::Span span(ctx_.tracer_, "build", "Plan " + _task);
+  const Task merged = merge(_task, _flavors);
+  std::vector<Toolchain::plan_t> dependencies;
+  for (const Dependency &dependency : merged.dependencies_) {
+    if (repo_.tasks_.find(dependency.name_) == repo_.tasks_.end()
+        && repo_.exports_.find(dependency.name_) == repo_.exports_.end()) {
+      // FIXME Build installed dependencies in their checkout, and ask for refresh (rebuild if needed)
+      if (ctx_.trunks_.has(dependency)) {
+        BRIEF_SV(ctx_.logger_, TRUNKS, "Dependency " << dependency.name_ << " of " << _task << " is installed.");
+        continue;
+      }
+      BRIEF_W(ctx_.logger_, "Dependency " << dependency.name_ << " of " << _task
+              << " isn't in this repo nor installed, skipped.");
+      continue;
+    }
+
+    dependencies.push_back(plan(_planning, dependency.name_,
+                                knownFlavors(dependency.name_, _flavors, dependency.require_)));
+  }
+
+  auto toolchain = ctx_.getToolchain(merged.toolchain_);
+  _planning.toolchains_.push_back(toolchain);
+  const Toolchain::plan_t result = toolchain->plan(_planning.scheduler_, _task, merged, _flavors, dependencies);
+  _planning.visiting_.erase(key);
+  _planning.plans_.emplace(key, result);
+  BRIEF_BIN(ctx_.binlog_, "Planned {} with toolchain {}, {} dependencies", key, merged.toolchain_, dependencies.size());
+  return result;
+}
 
-  // auto toolchain = ctx_.getToolchain(merged.toolchain_);
-  // toolchain->build(merged, _flavors);
+fs::path Builder::outputDir(const std::string &_task, const std::vector<std::string> &_flavors) const {
+  std::string flavors;
+  for (const std::string &flavor : _flavors)
+    flavors += (flavors.empty() ? "" : "-") + flavor;
+  return root_ / std::string(OUTPUT_DIR) / _task / (flavors.empty() ? "default" : flavors);
 }
 
 }  // namespace brief
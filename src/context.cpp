@@ -18,78 +18,135 @@
 
 
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "brief/context.hpp"
+#include "brief/toolchains/clang.hpp"
 
 namespace brief {
 
 Context::Context(Logger::level_t _level)
     : logger_(std::cout, _level), builder_(*this), trunks_(*this) {
+  snapshots_.emplace_back(new registries_t());
+  registries_.store(snapshots_.back().get(), std::memory_order_release);
+  registerToolchain(ClangToolchain::NAME, [](Context &_ctx) {
+    return std::make_shared<ClangToolchain>(_ctx);
+  });
+}
+
+struct Context::toolchain_entry_t {
+  explicit toolchain_entry_t(const Toolchain::Factory &_factory) : factory_(_factory) {}
+
+  Toolchain::Factory factory_;
+
+  std::once_flag created_;
+  bool reentrant_ = true;
+  std::shared_ptr<Toolchain> shared_;
+
+  /** Instances of a non reentrant toolchain, one per scheduler worker, and one per other thread calling. */
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<Toolchain>> workers_;
+  std::unordered_map<std::thread::id, std::shared_ptr<Toolchain>> threads_;
+};
+
+void Context::freeze() {
+  std::lock_guard<std::mutex> lock(registration_);
+  frozen_ = true;
+}
+
+void Context::update(const std::function<void(registries_t &_registries)> &_change) {
+  std::lock_guard<std::mutex> lock(registration_);
+  if (!frozen_) {
+    _change(*snapshots_.back());
+    return;
+  }
+  std::unique_ptr<registries_t> registries(new registries_t(*snapshots_.back()));
+  _change(*registries);
+  snapshots_.push_back(std::move(registries));
+  registries_.store(snapshots_.back().get(), std::memory_order_release);
 }
 
 void Context::registerToolchain(const std::string &_name, const Toolchain::Factory &_factory) {
-  toolchainFactories_.emplace(_name, _factory);
+  update([&_name, &_factory](registries_t &_registries) {
+    _registries.toolchains_[_name] = std::make_shared<toolchain_entry_t>(_factory);
+  });
 }
 
 std::shared_ptr<Toolchain> Context::getToolchain(const std::string &_name) {
-  auto it = toolchainFactories_.find(_name);
-  if (it == toolchainFactories_.end())
+  const registries_t &registries = this->registries();
+  auto it = registries.toolchains_.find(_name);
+  if (it == registries.toolchains_.end())
     throw std::runtime_error(std::string("Toolchain ") + _name + " not registered.");
-  return it->second(*this);
+  toolchain_entry_t &entry = *it->second;
+
+  std::shared_ptr<Toolchain> created;
+  std::call_once(entry.created_, [this, &entry, &created]() {
+    created = entry.factory_(*this);
+    entry.reentrant_ = created->reentrant();
+    if (entry.reentrant_)
+      entry.shared_ = created;
+  });
+  if (entry.reentrant_)
+    return entry.shared_;
+
+  std::lock_guard<std::mutex> lock(entry.mutex_);
+  const size_t worker = Scheduler::worker();
+  if (worker != Scheduler::NO_WORKER && entry.workers_.size() <= worker)
+    entry.workers_.resize(worker + 1);
+  std::shared_ptr<Toolchain> &instance = worker == Scheduler::NO_WORKER ? entry.threads_[std::this_thread::get_id()]
+                                                                        : entry.workers_[worker];
+  if (!instance)
+    instance = created ? created : entry.factory_(*this);
+  return instance;
+}
+
+void Context::registerVCSHandling(const std::string &_pattern, const VCS::Factory &_factory) {
+  update([&_pattern, &_factory](registries_t &_registries) {
+    _registries.vcsPatterns_.add(_pattern);
+    _registries.vcsFactories_.push_back(_factory);
+  });
 }
 
 void Context::registerVCSHandling(const std::regex &_pattern, const VCS::Factory &_factory) {
-  vcsFactories_.push_back(std::make_tuple(_pattern, _factory));
+  update([&_pattern, &_factory](registries_t &_registries) {
+    _registries.vcsPatterns_.add(_pattern);
+    _registries.vcsFactories_.push_back(_factory);
+  });
 }
 
 std::shared_ptr<VCS> Context::getVCS(const std::string &_uri) {
-  for (const auto &tuple : vcsFactories_) {
-    if (std::regex_match(_uri, std::get<std::regex>(tuple)))
-      return std::get<VCS::Factory>(tuple)(*this, _uri);
-  }
-  throw std::runtime_error(std::string("No known vcs can handle uri: ") + _uri);
+  const registries_t &registries = this->registries();
+  const size_t pattern = registries.vcsPatterns_.match(_uri);
+  if (pattern == UriMatcher::NONE)
+    throw std::runtime_error(std::string("No known vcs can handle uri: ") + _uri);
+  BRIEF_SD(logger_, VCS, "Handling " << _uri << " with VCS pattern " << pattern);
+  return registries.vcsFactories_[pattern](*this, _uri);
 }
 
 void Context::registerVar(const std::string &_name, const std::string &_value) {
-  knownVars_.emplace(_name, _value);
+  update([&_name, &_value](registries_t &_registries) {
+    _registries.knownVars_[_name] = _value;
+    _registries.varVersions_[_name]++;
+  });
 }
 
 void Context::registerVarPrefix(const std::string &_prefix, PrefixCallback _cb) {
-  varPrefixes_.emplace(_prefix, _cb);
+  update([&_prefix, &_cb](registries_t &_registries) {
+    _registries.varPrefixes_.emplace(_prefix, _cb);
+  });
 }
 
 std::string Context::preprocessString(const Repository &_repo,
                                       const Task &_task,
                                       const std::string &_value) {
-  // TODO Check for vars in the string
-  return _value;
+  return Scope(*this, _repo, _task).expand(_value);
 }
 
 std::string Context::lookupVar(const Repository &_repo, const Task &_task, const std::string &_name) {
-  auto symbols = _task.symbols_;
-  auto symbol = symbols.find(_name);
-  if (symbol != symbols.end())
-    return preprocessString(_repo, _task, symbol->second);
-
-  auto constants = _repo.constants_;
-  auto constant = constants.find(_name);
-  if (constant != constants.end())
-    return preprocessString(_repo, _task, constant->second);
-
-  auto known = knownVars_.find(_name);
-  if (known != knownVars_.end())
-    return known->second;
-
-  size_t offset = _name.find("::");
-  if (offset != std::string::npos) {
-    auto prefix = _name.substr(0, offset);
-    auto it = varPrefixes_.find(prefix);
-    if (it != varPrefixes_.end()) {
-      return it->second(_repo, _task, _name.substr(offset + 2));
-    }
-  }
-
-  throw std::runtime_error("Unknown variable: " + _name);
+  return Scope(*this, _repo, _task).lookup(_name);
 }
 
 }  // namespace brief
@@ -0,0 +1,185 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <git2.h>
+
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/git.hpp"
+
+#if LIBGIT2_VER_MAJOR < 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR < 7)
+#error "Shallow fetches need libgit2 1.7 or later."
+#endif
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void check(int _error, const std::string &_what) {
+  if (_error < 0) {
+    const git_error *error = git_error_last();
+    throw std::runtime_error(_what + ": " + (error ? error->message : "unknown libgit2 error"));
+  }
+}
+
+void initialize() {
+  static std::once_flag once;
+  std::call_once(once, [] { git_libgit2_init(); });
+}
+
+/** Remote released with its scope. */
+class Remote {
+ public:
+  Remote(git_repository *_repo, const std::string &_url) {
+    check(git_remote_lookup(&remote_, _repo, "origin"), "No origin for " + _url);
+  }
+
+  ~Remote() {
+    git_remote_free(remote_);
+  }
+
+  Remote(const Remote&) = delete;
+  Remote& operator=(const Remote&) = delete;
+
+  git_remote *get() const {
+    return remote_;
+  }
+
+ private:
+  git_remote *remote_ = nullptr;
+};
+
+}  // namespace
+
+constexpr int GitRepository::FULL;
+
+GitRepository::GitRepository(const fs::path &_dir, const std::string &_url) : url_(_url) {
+  initialize();
+  if (git_repository_open_bare(&repo_, _dir.c_str()) == 0)
+    return;
+  fs::create_directories(_dir);
+  check(git_repository_init(&repo_, _dir.c_str(), 1), "Can't initialize " + _dir.string());
+  git_remote *remote = nullptr;
+  check(git_remote_create(&remote, repo_, "origin", url_.c_str()), "Can't add remote " + url_);
+  git_remote_free(remote);
+}
+
+GitRepository::~GitRepository() {
+  git_repository_free(repo_);
+}
+
+std::vector<std::string> GitRepository::references() {
+  Remote remote(repo_, url_);
+  git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+  check(git_remote_connect(remote.get(), GIT_DIRECTION_FETCH, &callbacks, nullptr, nullptr), "Can't reach " + url_);
+  const git_remote_head **heads;
+  size_t count;
+  const int error = git_remote_ls(&heads, &count, remote.get());
+  std::vector<std::string> result;
+  for (size_t i = 0; error == 0 && i < count; i++)
+    result.push_back(heads[i]->name);
+  git_remote_disconnect(remote.get());
+  check(error, "Can't list the references of " + url_);
+  return result;
+}
+
+uint64_t GitRepository::fetch(const std::vector<std::string> &_refspecs, int _depth) {
+  Remote remote(repo_, url_);
+  std::vector<char*> strings;
+  for (const std::string &refspec : _refspecs)
+    strings.push_back(const_cast<char*>(refspec.c_str()));
+  git_strarray refspecs = {strings.data(), strings.size()};
+  git_fetch_options options = GIT_FETCH_OPTIONS_INIT;
+  options.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_NONE;
+  if (_depth != FULL)
+    options.depth = _depth;
+  else if (git_repository_is_shallow(repo_) == 1)
+    options.depth = GIT_FETCH_DEPTH_UNSHALLOW;
+  check(git_remote_fetch(remote.get(), &refspecs, &options, nullptr), "Can't fetch " + url_);
+  return git_remote_stats(remote.get())->received_bytes;
+}
+
+std::string GitRepository::resolve(const std::string &_rev) {
+  git_object *object = nullptr;
+  if (_rev.empty() || git_revparse_single(&object, repo_, _rev.c_str()) != 0)
+    return "";
+  git_object *commit = nullptr;
+  const int error = git_object_peel(&commit, object, GIT_OBJECT_COMMIT);
+  git_object_free(object);
+  if (error != 0)
+    return "";
+  char id[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(id, sizeof(id), git_object_id(commit));
+  git_object_free(commit);
+  return id;
+}
+
+bool GitRepository::contains(const std::string &_commit, const std::string &_ancestor) {
+  if (_commit == _ancestor)
+    return true;
+  git_oid commit, ancestor;
+  check(git_oid_fromstr(&commit, _commit.c_str()), "Invalid commit id " + _commit);
+  check(git_oid_fromstr(&ancestor, _ancestor.c_str()), "Invalid commit id " + _ancestor);
+  const int result = git_graph_descendant_of(repo_, &commit, &ancestor);
+  check(result, "Can't walk the history of " + url_);
+  return result == 1;
+}
+
+void GitRepository::checkout(const std::string &_id, const fs::path &_dir) {
+  git_repository *checkout = nullptr;
+  if (git_repository_open(&checkout, _dir.c_str()) != 0) {
+    fs::create_directories(_dir);
+    check(git_repository_init(&checkout, _dir.c_str(), 0), "Can't initialize " + _dir.string());
+  }
+
+  // Alternates are read when the object database opens, so the repository is opened again once they're set
+  const fs::path alternates = fs::path(git_repository_path(checkout)) / "objects" / "info" / "alternates";
+  git_repository_free(checkout);
+  fs::create_directories(alternates.parent_path());
+  {
+    std::ofstream dst(alternates.string(), std::ios::trunc);
+    dst << (fs::path(git_repository_path(repo_)) / "objects").string() << '\n';
+    if (!dst)
+      throw std::runtime_error("Can't write " + alternates.string());
+  }
+  check(git_repository_open(&checkout, _dir.c_str()), "Can't open " + _dir.string());
+
+  git_oid id;
+  git_object *commit = nullptr;
+  int error = git_oid_fromstr(&id, _id.c_str());
+  if (error == 0)
+    error = git_object_lookup(&commit, checkout, &id, GIT_OBJECT_COMMIT);
+  if (error == 0) {
+    git_checkout_options options = GIT_CHECKOUT_OPTIONS_INIT;
+    options.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_REMOVE_UNTRACKED;
+    error = git_checkout_tree(checkout, commit, &options);
+  }
+  if (error == 0)
+    error = git_repository_set_head_detached(checkout, &id);
+  git_object_free(commit);
+  git_repository_free(checkout);
+  check(error, "Can't checkout " + _id + " of " + url_);
+}
+
+}  // namespace brief
@@ -0,0 +1,92 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fnmatch.h>
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/builder.hpp"
+#include "brief/glob.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void globComponents(const fs::path &_root, const fs::path &_current,
+                    std::vector<std::string>::const_iterator _it, std::vector<std::string>::const_iterator _end,
+                    std::vector<fs::path> &_result) {
+  if (_it == _end) {
+    if (fs::is_regular_file(_root / _current))
+      _result.push_back(_current);
+    return;
+  }
+
+  const fs::path dir = _root / _current;
+  if (!fs::is_directory(dir))
+    return;
+
+  const std::string &component = *_it;
+  if (component == "**") {
+    globComponents(_root, _current, _it + 1, _end, _result);  // zero directories
+    for (fs::directory_iterator file(dir), end; file != end; ++file) {
+      // Symlinks aren't followed, they could loop
+      const std::string name = file->path().filename().string();
+      if (!fs::is_directory(file->symlink_status()) || name.front() == '.'
+          || (_current.empty() && name == Builder::OUTPUT_DIR))
+        continue;
+      globComponents(_root, _current / name, _it, _end, _result);
+    }
+  } else if (component.find_first_of("*?[") == std::string::npos) {
+    globComponents(_root, _current / component, _it + 1, _end, _result);
+  } else {
+    for (fs::directory_iterator file(dir), end; file != end; ++file) {
+      const std::string name = file->path().filename().string();
+      if (fnmatch(component.c_str(), name.c_str(), FNM_PERIOD) == 0)
+        globComponents(_root, _current / name, _it + 1, _end, _result);
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<fs::path> glob(const fs::path &_root, const std::string &_pattern) {
+  if (_pattern.find_first_of("*?[") == std::string::npos)
+    return {fs::path(_pattern)};
+
+  std::vector<std::string> components;
+  size_t start = 0;
+  while (start <= _pattern.size()) {
+    size_t end = _pattern.find('/', start);
+    if (end == std::string::npos)
+      end = _pattern.size();
+    if (end != start)
+      components.emplace_back(_pattern.substr(start, end - start));
+    start = end + 1;
+  }
+
+  std::vector<fs::path> result;
+  globComponents(_root, fs::path(), components.cbegin(), components.cend(), result);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+}  // namespace brief
@@ -0,0 +1,40 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <stdexcept>
+
+#include "brief/hash.hpp"
+
+namespace brief {
+
+uint64_t hashFile(const boost::filesystem::path &_path) {
+  std::ifstream src(_path.string(), std::ios::binary);
+  if (!src.is_open())
+    throw std::runtime_error("Can't hash " + _path.string() + ", unable to open it.");
+
+  Hasher hasher;
+  char buffer[64 * 1024];
+  while (src) {
+    src.read(buffer, sizeof(buffer));
+    hasher.update(buffer, static_cast<size_t>(src.gcount()));
+  }
+  return hasher.digest();
+}
+
+}  // namespace brief
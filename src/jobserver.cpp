@@ -0,0 +1,198 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/jobserver.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+/** Opens our own non blocking file description of an inherited pipe end, so that a token stolen by another process
+ * between poll and read doesn't block us (and we don't change the flags of the description make shares). */
+int reopen(int _fd, int _flags) {
+  if (fcntl(_fd, F_GETFD) < 0)
+    return -1;
+  const int fd = open(("/proc/self/fd/" + std::to_string(_fd)).c_str(), _flags | O_NONBLOCK | O_CLOEXEC);
+  return fd >= 0 ? fd : fcntl(_fd, F_DUPFD_CLOEXEC, 0);
+}
+
+}  // namespace
+
+std::unique_ptr<Jobserver> Jobserver::join(const std::string &_makeflags) {
+  // The last option wins, as for make
+  size_t start = std::string::npos;
+  for (const char *option : {"--jobserver-fds=", "--jobserver-auth="}) {
+    const size_t found = _makeflags.rfind(option);
+    if (found != std::string::npos && (start == std::string::npos || found + strlen(option) > start))
+      start = found + strlen(option);
+  }
+  if (start == std::string::npos)
+    return nullptr;
+  const std::string auth = _makeflags.substr(start, _makeflags.find(' ', start) - start);
+
+  if (auth.compare(0, 5, "fifo:") == 0) {
+    const fs::path fifo = auth.substr(5);
+    const int fd = open(fifo.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+      return nullptr;
+    return std::unique_ptr<Jobserver>(new Jobserver(fd, fd, fifo, false));
+  }
+
+  // Negative fds mean make didn't share its jobserver with us (command not marked as recursive)
+  const size_t comma = auth.find(',');
+  if (comma == std::string::npos)
+    return nullptr;
+  const int readFd = std::atoi(auth.c_str()), writeFd = std::atoi(auth.c_str() + comma + 1);
+  if (readFd < 0 || writeFd < 0)
+    return nullptr;
+  const int read = reopen(readFd, O_RDONLY), write = reopen(writeFd, O_WRONLY);
+  if (read < 0 || write < 0) {
+    if (read >= 0)
+      close(read);
+    if (write >= 0)
+      close(write);
+    return nullptr;
+  }
+  return std::unique_ptr<Jobserver>(new Jobserver(read, write, fs::path(), false));
+}
+
+std::unique_ptr<Jobserver> Jobserver::create(size_t _jobs) {
+  const fs::path fifo = fs::temp_directory_path() / fs::unique_path("brief-jobserver-%%%%-%%%%-%%%%");
+  if (mkfifo(fifo.c_str(), 0600) != 0)
+    throw std::runtime_error("Can't create jobserver fifo " + fifo.string() + ": " + strerror(errno));
+  const int fd = open(fifo.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    fs::remove(fifo);
+    throw std::runtime_error("Can't open jobserver fifo " + fifo.string() + ": " + strerror(errno));
+  }
+
+  std::unique_ptr<Jobserver> result(new Jobserver(fd, fd, fifo, true));
+  result->jobs_ = _jobs;
+  const std::string tokens(_jobs > 1 ? _jobs - 1 : 0, '+');
+  if (!tokens.empty() && write(fd, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+    throw std::runtime_error("Can't fill jobserver fifo " + fifo.string() + ": " + strerror(errno));
+  return result;
+}
+
+Jobserver::Jobserver(int _read, int _write, const fs::path &_fifo, bool _owner)
+    : read_(_read), write_(_write), interrupt_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), fifo_(_fifo),
+      owner_(_owner) {
+}
+
+Jobserver::~Jobserver() {
+  // Tokens still held are given back best effort, a destructor can't throw and the jobserver may be gone already
+  for (const char token : held_) {
+    ssize_t size;
+    do {
+      size = ::write(write_, &token, 1);
+    } while (size < 0 && errno == EINTR);
+    if (size != 1)
+      break;
+  }
+  close(interrupt_);
+  close(read_);
+  if (write_ != read_)
+    close(write_);
+  if (owner_) {
+    boost::system::error_code error;
+    fs::remove(fifo_, error);
+  }
+}
+
+bool Jobserver::take() {
+  char token;
+  ssize_t size;
+  do {
+    size = ::read(read_, &token, 1);
+  } while (size < 0 && errno == EINTR);
+  if (size == 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_.push_back(token);
+    return true;
+  }
+  if (size == 0 || errno != EAGAIN)
+    throw std::runtime_error(std::string("Jobserver closed or unreadable: ") + (size == 0 ? "EOF" : strerror(errno)));
+  return false;
+}
+
+bool Jobserver::tryAcquire() {
+  return take();
+}
+
+bool Jobserver::acquire() {
+  while (!take()) {
+    pollfd fds[2] = {{read_, POLLIN, 0}, {interrupt_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR)
+      throw std::runtime_error(std::string("Can't wait for jobserver: ") + strerror(errno));
+    if (fds[1].revents & POLLIN) {
+      uint64_t count;
+      if (::read(interrupt_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        throw std::runtime_error(std::string("Can't read jobserver interruption: ") + strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+void Jobserver::release() {
+  char token = '+';
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!held_.empty()) {
+      token = held_.back();
+      held_.pop_back();
+    }
+  }
+  ssize_t size;
+  do {
+    size = ::write(write_, &token, 1);
+  } while (size < 0 && errno == EINTR);
+  if (size != 1)
+    throw std::runtime_error(std::string("Can't give back jobserver token: ") + strerror(errno));
+}
+
+void Jobserver::interrupt() {
+  const uint64_t one = 1;
+  if (::write(interrupt_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    throw std::runtime_error(std::string("Can't interrupt jobserver: ") + strerror(errno));
+}
+
+std::string Jobserver::makeflags() const {
+  // Subprocesses can't inherit our descriptors, only the fifo form can be shared
+  std::string result;
+  if (jobs_ > 0)
+    result += "-j" + std::to_string(jobs_) + " ";
+  return result + "--jobserver-auth=fifo:" + fifo_.string();
+}
+
+}  // namespace brief
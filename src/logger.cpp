@@ -0,0 +1,228 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "brief/logger.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+
+namespace brief {
+
+std::atomic<uint64_t> Logger::nextId_ {0};
+constexpr size_t Logger::ring_t::CAPACITY;
+
+namespace {
+
+/** Line being formatted by the current thread, between Logger::begin and Logger::commit. */
+std::ostringstream& line() {
+  thread_local std::ostringstream line;
+  return line;
+}
+
+const char* name(Logger::level_t _level) {
+  switch (_level) {
+    case Logger::W: return "WARN";
+    case Logger::I: return "INFO";
+    case Logger::V: return "VERB";
+    case Logger::D: return "DBUG";
+  }
+  return "";
+}
+
+constexpr const char *SUBSYSTEM_NAMES[Logger::SUBSYSTEMS] = {
+    "general", "parser", "cache", "scheduler", "trunks", "vcs"};
+
+Logger::level_t parseLevel(const std::string &_name) {
+  if (_name == "warn")
+    return Logger::W;
+  if (_name == "info")
+    return Logger::I;
+  if (_name == "verbose")
+    return Logger::V;
+  if (_name == "debug")
+    return Logger::D;
+  throw std::runtime_error("Unknown log level: " + _name);
+}
+
+}  // namespace
+
+Logger::Logger(std::ostream &_stream, level_t _level)
+    : target_(_stream), start_(std::chrono::system_clock::now()) {
+  setLevel(_level);
+  writer_ = std::thread(&Logger::write, this);
+  const auto time = std::chrono::system_clock::to_time_t(start_);
+  std::string date = std::ctime(&time);
+  if (!date.empty() && date.back() == '\n')
+    date.pop_back();
+  BRIEF_V(*this, "Log start: " << date);
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+}
+
+void Logger::setLevel(level_t _level) {
+  for (auto &level : levels_)
+    level.store(_level);
+}
+
+void Logger::setLevel(subsystem_t _subsystem, level_t _level) {
+  levels_[_subsystem].store(_level);
+}
+
+void Logger::configure(const std::string &_levels) {
+  size_t start = 0;
+  while (start < _levels.size()) {
+    size_t end = _levels.find(',', start);
+    if (end == std::string::npos)
+      end = _levels.size();
+    const std::string setting = _levels.substr(start, end - start);
+    start = end + 1;
+
+    const size_t equal = setting.find('=');
+    if (equal == std::string::npos) {
+      setLevel(parseLevel(setting));
+      continue;
+    }
+    const std::string subsystem = setting.substr(0, equal);
+    const auto found = std::find(std::begin(SUBSYSTEM_NAMES), std::end(SUBSYSTEM_NAMES), subsystem);
+    if (found == std::end(SUBSYSTEM_NAMES))
+      throw std::runtime_error("Unknown log subsystem: " + subsystem);
+    setLevel(static_cast<subsystem_t>(found - std::begin(SUBSYSTEM_NAMES)), parseLevel(setting.substr(equal + 1)));
+  }
+}
+
+std::ostream& Logger::begin() {
+  std::ostringstream &stream = line();
+  stream.str(std::string());
+  stream.clear();
+  return stream;
+}
+
+void Logger::commit(level_t _level, subsystem_t _subsystem) {
+  ring_t &ring = this->ring();
+  const size_t tail = ring.tail_.load(std::memory_order_relaxed);
+  while (tail - ring.head_.load(std::memory_order_acquire) == ring_t::CAPACITY) {
+    wake();
+    std::this_thread::yield();
+  }
+  entry_t &entry = ring.entries_[tail % ring_t::CAPACITY];
+  entry.time_ = std::chrono::system_clock::now();
+  entry.level_ = _level;
+  entry.subsystem_ = _subsystem;
+  entry.text_ = line().str();
+  ring.tail_.store(tail + 1, std::memory_order_release);
+  committed_.fetch_add(1, std::memory_order_release);
+  if (_level == W)
+    flush();
+  else if (!signaled_.exchange(true))
+    wake();
+}
+
+void Logger::flush() {
+  const uint64_t committed = committed_.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lock(mutex_);
+  requested_ = true;
+  wake_.notify_one();
+  done_.wait(lock, [this, committed]() { return written_ >= committed; });
+}
+
+Logger::ring_t& Logger::ring() {
+  // Loggers ids are never reused, so the rings of destroyed loggers are never looked up
+  thread_local std::unordered_map<uint64_t, ring_t*> rings;
+  ring_t *&ring = rings[id_];
+  if (ring == nullptr) {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    rings_.emplace_back(new ring_t);
+    ring = rings_.back().get();
+  }
+  return *ring;
+}
+
+void Logger::wake() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requested_ = true;
+  }
+  wake_.notify_one();
+}
+
+void Logger::write() {
+  std::vector<entry_t> batch;
+  std::ostringstream text;
+  std::chrono::system_clock::time_point last = start_;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this]() { return requested_ || stopping_; });
+    const bool stopping = stopping_;
+    requested_ = false;
+    lock.unlock();
+
+    // Lines committed from now on signal again, those committed before are drained below
+    signaled_.exchange(false);
+
+    const size_t count = drain(batch);
+    if (count > 0) {
+      // Rings are ordered, lines of different threads are interleaved by time. A line committed while the previous
+      // batch was drained can be older than its last line, its timestamp is raised so they stay ordered.
+      std::stable_sort(batch.begin(), batch.end(), [](const entry_t &_a, const entry_t &_b) {
+        return _a.time_ < _b.time_;
+      });
+      text.str(std::string());
+      for (const entry_t &entry : batch) {
+        last = std::max(last, entry.time_);
+        const auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(last - start_);
+        text << '[' << std::setw(10) << diff.count() << "] " << name(entry.level_) << ' ';
+        if (entry.subsystem_ != GENERAL)
+          text << SUBSYSTEM_NAMES[entry.subsystem_] << ": ";
+        text << entry.text_ << '\n';
+      }
+      batch.clear();
+      target_ << text.str();
+      target_.flush();
+    }
+
+    lock.lock();
+    written_ += count;
+    done_.notify_all();
+    if (stopping)
+      break;
+  }
+}
+
+size_t Logger::drain(std::vector<entry_t> &_batch) {
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  const size_t before = _batch.size();
+  for (const auto &ring : rings_) {
+    size_t head = ring->head_.load(std::memory_order_relaxed);
+    const size_t tail = ring->tail_.load(std::memory_order_acquire);
+    for (; head != tail; ++head)
+      _batch.push_back(std::move(ring->entries_[head % ring_t::CAPACITY]));
+    ring->head_.store(head, std::memory_order_release);
+  }
+  return _batch.size() - before;
+}
+
+}  // namespace brief
@@ -0,0 +1,132 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+
+#include "brief/matcher.hpp"
+
+namespace brief {
+
+constexpr size_t UriMatcher::NONE;
+constexpr size_t UriMatcher::SHARDS;
+constexpr size_t UriMatcher::CAPACITY;
+
+size_t UriMatcher::add(const std::string &_pattern) {
+  bool literal;
+  const std::string prefix = UriMatcher::prefix(_pattern, literal);
+  patterns_.push_back({literal ? std::regex() : std::regex(_pattern), literal, prefix});
+  index(prefix, patterns_.size() - 1);
+  return patterns_.size() - 1;
+}
+
+size_t UriMatcher::add(const std::regex &_pattern) {
+  patterns_.push_back({_pattern, false, std::string()});
+  index(std::string(), patterns_.size() - 1);
+  return patterns_.size() - 1;
+}
+
+void UriMatcher::index(const std::string &_prefix, size_t _pattern) {
+  size_t node = 0;
+  for (char c : _prefix) {
+    auto child = nodes_[node].children_.find(c);
+    if (child == nodes_[node].children_.end()) {
+      nodes_.emplace_back();
+      child = nodes_[node].children_.emplace(c, nodes_.size() - 1).first;
+    }
+    node = child->second;
+  }
+  nodes_[node].patterns_.push_back(_pattern);
+  for (shard_t &shard : memo_) {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    shard.results_.clear();
+  }
+}
+
+size_t UriMatcher::match(const std::string &_uri) const {
+  shard_t &shard = memo_[std::hash<std::string>()(_uri) % SHARDS];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    auto memoized = shard.results_.find(_uri);
+    if (memoized != shard.results_.end())
+      return memoized->second;
+  }
+
+  // Patterns whose prefix the URI starts with, in the order they were added
+  std::vector<size_t> candidates(nodes_[0].patterns_);
+  size_t node = 0;
+  for (char c : _uri) {
+    auto child = nodes_[node].children_.find(c);
+    if (child == nodes_[node].children_.end())
+      break;
+    node = child->second;
+    candidates.insert(candidates.end(), nodes_[node].patterns_.begin(), nodes_[node].patterns_.end());
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  size_t result = NONE;
+  for (size_t candidate : candidates) {
+    const pattern_t &pattern = patterns_[candidate];
+    if (pattern.literal_ ? pattern.text_ == _uri : std::regex_match(_uri, pattern.regex_)) {
+      result = candidate;
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(shard.mutex_);
+  if (shard.results_.size() >= CAPACITY)
+    shard.results_.clear();
+  shard.results_.emplace(_uri, result);
+  return result;
+}
+
+std::string UriMatcher::prefix(const std::string &_pattern, bool &_literal) {
+  _literal = false;
+  // Alternatives might not share a prefix
+  if (_pattern.find('|') != std::string::npos)
+    return std::string();
+
+  std::string result;
+  size_t i = _pattern.size() > 0 && _pattern[0] == '^' ? 1 : 0;
+  while (i < _pattern.size()) {
+    char c = _pattern[i];
+    size_t next = i + 1;
+    if (c == '\\') {
+      // Escaped punctuation is literal, classes like \d aren't
+      if (next == _pattern.size() || std::isalnum(static_cast<unsigned char>(_pattern[next])))
+        return result;
+      c = _pattern[next++];
+    } else if (std::strchr(".[](){}*+?^$", c)) {
+      return result;
+    }
+    // A quantified character might not be there
+    if (next < _pattern.size() && std::strchr("*?{", _pattern[next]))
+      return result;
+    if (next < _pattern.size() && _pattern[next] == '+') {
+      result += c;
+      return result;
+    }
+    result += c;
+    i = next;
+  }
+  _literal = true;
+  return result;
+}
+
+}  // namespace brief
@@ -0,0 +1,221 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "brief/metrics.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include "brief/json.hpp"
+
+namespace brief {
+
+namespace {
+
+/** Bits of a value kept by its bucket, 16 buckets per power of two. */
+constexpr unsigned PRECISION = 4;
+constexpr uint64_t SUB_BUCKETS = uint64_t(1) << PRECISION;
+
+/** Index of the most significant bit of a non zero value. */
+unsigned msb(uint64_t _value) {
+  return 63 - static_cast<unsigned>(__builtin_clzll(_value));
+}
+
+bool valid(const std::string &_name) {
+  if (_name.empty() || std::isdigit(static_cast<unsigned char>(_name[0])))
+    return false;
+  return std::all_of(_name.begin(), _name.end(), [](char _c) {
+    return std::isalnum(static_cast<unsigned char>(_c)) || _c == '_' || _c == ':';
+  });
+}
+
+const double QUANTILES[] = {0.5, 0.9, 0.99};
+
+}  // namespace
+
+constexpr size_t Metrics::SHARDS;
+constexpr size_t Metrics::Histogram::BUCKETS;
+
+size_t Metrics::shard() {
+  static std::atomic<size_t> next {0};
+  thread_local const size_t shard = next++ % SHARDS;
+  return shard;
+}
+
+uint64_t Metrics::Counter::value() const {
+  uint64_t value = 0;
+  for (const shard_t &shard : shards_)
+    value += shard.value_.load(std::memory_order_relaxed);
+  return value;
+}
+
+Metrics::Histogram::Histogram() : shards_(new shard_t[SHARDS]()) {
+}
+
+size_t Metrics::Histogram::bucket(uint64_t _value) {
+  // Values below 2 * SUB_BUCKETS have a bucket each, the others share one with the values of same leading bits
+  if (_value < 2 * SUB_BUCKETS)
+    return static_cast<size_t>(_value);
+  const unsigned shift = msb(_value) - PRECISION;
+  return static_cast<size_t>((shift + 1) * SUB_BUCKETS + (_value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t Metrics::Histogram::lowest(size_t _bucket) {
+  if (_bucket < 2 * SUB_BUCKETS)
+    return _bucket;
+  const unsigned shift = static_cast<unsigned>(_bucket / SUB_BUCKETS - 1);
+  return (_bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+uint64_t Metrics::Histogram::highest(size_t _bucket) {
+  return _bucket + 1 < BUCKETS ? lowest(_bucket + 1) - 1 : UINT64_MAX;
+}
+
+void Metrics::Histogram::record(uint64_t _value) {
+  shard_t &shard = shards_[Metrics::shard()];
+  shard.buckets_[bucket(_value)].fetch_add(1, std::memory_order_relaxed);
+  shard.sum_.fetch_add(_value, std::memory_order_relaxed);
+
+  uint64_t min = min_.load(std::memory_order_relaxed);
+  while (_value < min && !min_.compare_exchange_weak(min, _value, std::memory_order_relaxed)) {}
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (_value > max && !max_.compare_exchange_weak(max, _value, std::memory_order_relaxed)) {}
+}
+
+Metrics::Histogram::snapshot_t Metrics::Histogram::snapshot() const {
+  snapshot_t snapshot;
+  snapshot.buckets_.assign(BUCKETS, 0);
+  for (size_t s = 0; s < SHARDS; s++) {
+    for (size_t b = 0; b < BUCKETS; b++) {
+      const uint64_t count = shards_[s].buckets_[b].load(std::memory_order_relaxed);
+      snapshot.buckets_[b] += count;
+      snapshot.count_ += count;
+    }
+    snapshot.sum_ += shards_[s].sum_.load(std::memory_order_relaxed);
+  }
+  if (snapshot.count_ > 0) {
+    snapshot.min_ = min_.load(std::memory_order_relaxed);
+    snapshot.max_ = max_.load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+uint64_t Metrics::Histogram::snapshot_t::percentile(double _quantile) const {
+  if (count_ == 0)
+    return 0;
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(_quantile * count_)));
+  uint64_t seen = 0;
+  for (size_t b = 0; b < buckets_.size(); b++) {
+    seen += buckets_[b];
+    if (seen >= rank)
+      return std::min(std::max(highest(b), min_), max_);
+  }
+  return max_;
+}
+
+template <typename T>
+T& Metrics::add(std::map<std::string, metric_t<T>> &_metrics, const std::string &_name, const std::string &_help) {
+  auto found = _metrics.find(_name);
+  if (found == _metrics.end())
+    found = _metrics.emplace(_name, metric_t<T>{_help, std::unique_ptr<T>(new T)}).first;
+  return *found->second.metric_;
+}
+
+Metrics::Counter& Metrics::counter(const std::string &_name, const std::string &_help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!valid(_name) || gauges_.count(_name) || histograms_.count(_name))
+    throw std::runtime_error("Invalid or already registered metric name: " + _name);
+  return add(counters_, _name, _help);
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string &_name, const std::string &_help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!valid(_name) || counters_.count(_name) || histograms_.count(_name))
+    throw std::runtime_error("Invalid or already registered metric name: " + _name);
+  return add(gauges_, _name, _help);
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string &_name, const std::string &_help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!valid(_name) || counters_.count(_name) || gauges_.count(_name))
+    throw std::runtime_error("Invalid or already registered metric name: " + _name);
+  return add(histograms_, _name, _help);
+}
+
+void Metrics::writeJson(std::ostream &_dst) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  _dst << "{\"counters\":{";
+  bool first = true;
+  for (const auto &counter : counters_) {
+    _dst << (first ? "" : ",") << "\n\"" << json_escape(counter.first) << "\":" << counter.second.metric_->value();
+    first = false;
+  }
+  _dst << "},\n\"gauges\":{";
+  first = true;
+  for (const auto &gauge : gauges_) {
+    _dst << (first ? "" : ",") << "\n\"" << json_escape(gauge.first) << "\":" << gauge.second.metric_->value();
+    first = false;
+  }
+  _dst << "},\n\"histograms\":{";
+  first = true;
+  for (const auto &histogram : histograms_) {
+    const Histogram::snapshot_t snapshot = histogram.second.metric_->snapshot();
+    _dst << (first ? "" : ",") << "\n\"" << json_escape(histogram.first) << "\":{\"count\":" << snapshot.count_
+         << ",\"sum\":" << snapshot.sum_ << ",\"min\":" << snapshot.min_ << ",\"max\":" << snapshot.max_
+         << ",\"p50\":" << snapshot.percentile(0.5) << ",\"p90\":" << snapshot.percentile(0.9)
+         << ",\"p99\":" << snapshot.percentile(0.99) << '}';
+    first = false;
+  }
+  _dst << "}}\n";
+}
+
+void Metrics::writePrometheus(std::ostream &_dst) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &counter : counters_) {
+    _dst << "# HELP " << counter.first << ' ' << counter.second.help_ << "\n# TYPE " << counter.first << " counter\n"
+         << counter.first << ' ' << counter.second.metric_->value() << '\n';
+  }
+  for (const auto &gauge : gauges_) {
+    _dst << "# HELP " << gauge.first << ' ' << gauge.second.help_ << "\n# TYPE " << gauge.first << " gauge\n"
+         << gauge.first << ' ' << gauge.second.metric_->value() << '\n';
+  }
+  for (const auto &histogram : histograms_) {
+    const Histogram::snapshot_t snapshot = histogram.second.metric_->snapshot();
+    _dst << "# HELP " << histogram.first << ' ' << histogram.second.help_ << "\n# TYPE " << histogram.first
+         << " summary\n";
+    for (double quantile : QUANTILES)
+      _dst << histogram.first << "{quantile=\"" << quantile << "\"} " << snapshot.percentile(quantile) << '\n';
+    _dst << histogram.first << "_sum " << snapshot.sum_ << '\n' << histogram.first << "_count " << snapshot.count_
+         << '\n';
+  }
+}
+
+void Metrics::write(const boost::filesystem::path &_path) const {
+  std::ofstream dst(_path.string());
+  if (!dst)
+    throw std::runtime_error("Can't write metrics " + _path.string());
+  if (_path.extension() == ".json")
+    writeJson(dst);
+  else
+    writePrometheus(dst);
+}
+
+}  // namespace brief
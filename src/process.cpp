@@ -0,0 +1,371 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/process.hpp"
+
+extern char **environ;
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+struct Spawner::job_t {
+  pid_t pid_ = -1;
+  int output_ = -1, pidfd_ = -1;
+  bool exited_ = false;
+  process_result_t result_;
+  Callback callback_;
+  fs::path responseFile_;
+};
+
+struct Spawner::env_t {
+  std::vector<std::string> entries_;
+  std::vector<char*> pointers_;
+};
+
+namespace {
+
+/** Epoll events carry a job id, shifted to flag pidfd events with the lowest bit, 0 being the wakeup eventfd. */
+constexpr uint64_t WAKEUP_ID = 0;
+constexpr uint64_t EXIT_FLAG = 1;
+
+void throwErrno(const std::string &_what, int _errno = errno) {
+  throw std::runtime_error(_what + ": " + strerror(_errno));
+}
+
+int openPidfd(pid_t _pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(syscall(SYS_pidfd_open, _pid, 0));
+#else
+  return -1;
+#endif
+}
+
+int decodeStatus(int _status) {
+  if (WIFEXITED(_status))
+    return WEXITSTATUS(_status);
+  if (WIFSIGNALED(_status))
+    return 128 + WTERMSIG(_status);
+  return -1;
+}
+
+/** Quotes an argument as expected in GNU and clang response files. */
+std::string quote(const std::string &_arg) {
+  std::string result = "\"";
+  for (char c : _arg) {
+    if (c == '"' || c == '\\')
+      result.push_back('\\');
+    result.push_back(c);
+  }
+  result.push_back('"');
+  return result;
+}
+
+}  // namespace
+
+Spawner::Spawner(size_t _responseFileThreshold) : responseFileThreshold_(_responseFileThreshold) {
+  epoll_ = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epoll_ < 0 || wakeup_ < 0)
+    throwErrno("Can't setup process spawner");
+
+  epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.u64 = WAKEUP_ID;
+  if (epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &event) != 0) {
+    const int error = errno;
+    close(wakeup_);
+    close(epoll_);
+    throwErrno("Can't setup process spawner", error);
+  }
+}
+
+Spawner::~Spawner() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  const uint64_t one = 1;
+  if (write(wakeup_, &one, sizeof(one)) < 0) {
+    // Nothing to do, the loop thread might not even be started
+  }
+  if (loop_.joinable())
+    loop_.join();
+  close(wakeup_);
+  close(epoll_);
+}
+
+void Spawner::setEnv(const std::string &_name, const std::string &_value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  envOverrides_[_name] = _value;
+  env_.reset();
+}
+
+std::shared_ptr<Spawner::env_t> Spawner::environment() {
+  if (!env_) {
+    auto env = std::make_shared<env_t>();
+    for (char **cur = environ; *cur != nullptr; cur++) {
+      const std::string entry(*cur);
+      if (envOverrides_.find(entry.substr(0, entry.find('='))) == envOverrides_.end())
+        env->entries_.push_back(entry);
+    }
+    for (const auto &override : envOverrides_)
+      env->entries_.push_back(override.first + '=' + override.second);
+    for (std::string &entry : env->entries_)
+      env->pointers_.push_back(&entry[0]);
+    env->pointers_.push_back(nullptr);
+    env_ = env;
+  }
+  return env_;
+}
+
+void Spawner::spawn(const std::vector<std::string> &_args, Callback _cb, bool _responseFile) {
+  if (_args.empty())
+    throw std::invalid_argument("Can't spawn an empty command line.");
+
+  std::unique_ptr<job_t> job(new job_t());
+  job->callback_ = std::move(_cb);
+
+  std::vector<std::string> args = _args;
+  size_t length = 0;
+  for (const std::string &arg : args)
+    length += arg.size() + 1;
+  if (_responseFile && length > responseFileThreshold_) {
+    job->responseFile_ = fs::temp_directory_path() / fs::unique_path("brief-%%%%-%%%%-%%%%.rsp");
+    std::ofstream dst(job->responseFile_.string());
+    for (size_t i = 1; i < args.size(); i++)
+      dst << quote(args[i]) << '\n';
+    args.resize(1);
+    args.push_back('@' + job->responseFile_.string());
+  }
+  std::vector<char*> argv;
+  for (std::string &arg : args)
+    argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+
+  // Not pooled: without pidfd a job ends on output EOF, which needs every write end of its pipe closed
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0)
+    throwErrno("Can't create a pipe for " + args[0]);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attributes, &signals);
+  sigaddset(&signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attributes, &signals);
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+  flags |= POSIX_SPAWN_USEVFORK;
+#endif
+  posix_spawnattr_setflags(&attributes, flags);
+
+  std::shared_ptr<env_t> env;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    env = environment();
+  }
+  const int error = posix_spawnp(&job->pid_, argv[0], &actions, &attributes, argv.data(), env->pointers_.data());
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attributes);
+  close(fds[1]);
+  if (error != 0) {
+    close(fds[0]);
+    if (!job->responseFile_.empty())
+      fs::remove(job->responseFile_);
+    throwErrno("Can't spawn " + args[0], error);
+  }
+
+  job->output_ = fds[0];
+  fcntl(job->output_, F_SETFL, fcntl(job->output_, F_GETFL) | O_NONBLOCK);
+  job->pidfd_ = openPidfd(job->pid_);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!loop_.joinable() && failure_.empty())
+    loop_ = std::thread(&Spawner::loop, this);
+  const uint64_t id = nextId_++;
+  epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.u64 = id << 1;
+  if (!failure_.empty() || epoll_ctl(epoll_, EPOLL_CTL_ADD, job->output_, &event) != 0) {
+    // Nothing would ever report the end of the process
+    const std::string error = failure_.empty() ? strerror(errno) : failure_;
+    lock.unlock();
+    kill(job->pid_, SIGKILL);
+    waitpid(job->pid_, nullptr, 0);
+    close(job->output_);
+    if (job->pidfd_ >= 0)
+      close(job->pidfd_);
+    if (!job->responseFile_.empty())
+      fs::remove(job->responseFile_);
+    throw std::runtime_error("Can't wait for " + args[0] + ": " + error);
+  }
+  event.data.u64 = (id << 1) | EXIT_FLAG;
+  if (job->pidfd_ >= 0 && epoll_ctl(epoll_, EPOLL_CTL_ADD, job->pidfd_, &event) != 0) {
+    // The end of the output then tells when to wait for the process
+    close(job->pidfd_);
+    job->pidfd_ = -1;
+  }
+  jobs_.emplace(id, std::move(job));
+  running_++;
+}
+
+void Spawner::fail(const std::string &_error) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  failure_ = _error;
+  while (!jobs_.empty()) {
+    std::unique_ptr<job_t> job = std::move(jobs_.begin()->second);
+    jobs_.erase(jobs_.begin());
+    lock.unlock();
+
+    if (!job->exited_) {
+      kill(job->pid_, SIGKILL);
+      waitpid(job->pid_, nullptr, 0);
+    }
+    if (job->output_ >= 0)
+      close(job->output_);
+    if (job->pidfd_ >= 0)
+      close(job->pidfd_);
+    if (!job->responseFile_.empty())
+      fs::remove(job->responseFile_);
+    job->result_.status_ = -1;
+    job->result_.output_ += _error + '\n';
+    job->callback_(job->result_);
+
+    lock.lock();
+    running_--;
+    idle_.notify_all();
+  }
+}
+
+process_result_t Spawner::run(const std::vector<std::string> &_args, bool _responseFile) {
+  auto promise = std::make_shared<std::promise<process_result_t>>();
+  auto future = promise->get_future();
+  spawn(_args, [promise](const process_result_t &_result) {
+    promise->set_value(_result);
+  }, _responseFile);
+  return future.get();
+}
+
+void Spawner::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return running_ == 0; });
+}
+
+size_t Spawner::running() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_;
+}
+
+void Spawner::loop() {
+  epoll_event events[64];
+  while (true) {
+    const int count = epoll_wait(epoll_, events, 64, -1);
+    if (count < 0 && errno != EINTR) {
+      fail(std::string("Process spawner can't wait for events: ") + strerror(errno));
+      return;
+    }
+
+    for (int i = 0; i < count; i++) {
+      const uint64_t id = events[i].data.u64 >> 1;
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (id == WAKEUP_ID) {
+        uint64_t value;
+        if (read(wakeup_, &value, sizeof(value)) >= 0 && stopping_)
+          return;
+        continue;
+      }
+
+      auto it = jobs_.find(id);
+      if (it == jobs_.end())
+        continue;
+      job_t &job = *it->second;
+
+      if (events[i].data.u64 & EXIT_FLAG) {
+        int status;
+        struct rusage usage;
+        if (wait4(job.pid_, &status, WNOHANG, &usage) == job.pid_) {
+          job.exited_ = true;
+          job.result_.status_ = decodeStatus(status);
+          job.result_.peakMemory_ = static_cast<uint64_t>(usage.ru_maxrss);
+          epoll_ctl(epoll_, EPOLL_CTL_DEL, job.pidfd_, nullptr);
+          close(job.pidfd_);
+          job.pidfd_ = -1;
+        }
+      } else {
+        char buffer[16 * 1024];
+        ssize_t size;
+        while ((size = read(job.output_, buffer, sizeof(buffer))) > 0)
+          job.result_.output_.append(buffer, static_cast<size_t>(size));
+        if (size == 0 || (errno != EAGAIN && errno != EINTR)) {
+          epoll_ctl(epoll_, EPOLL_CTL_DEL, job.output_, nullptr);
+          close(job.output_);
+          job.output_ = -1;
+          if (job.pidfd_ < 0 && !job.exited_) {  // Without pidfd, the closed pipe is our best hint of an exit
+            int status;
+            struct rusage usage;
+            wait4(job.pid_, &status, 0, &usage);
+            job.exited_ = true;
+            job.result_.status_ = decodeStatus(status);
+            job.result_.peakMemory_ = static_cast<uint64_t>(usage.ru_maxrss);
+          }
+        }
+      }
+
+      if (job.output_ < 0 && job.exited_) {
+        std::unique_ptr<job_t> done = std::move(it->second);
+        jobs_.erase(it);
+        lock.unlock();
+        if (!done->responseFile_.empty())
+          fs::remove(done->responseFile_);
+        done->callback_(done->result_);
+        lock.lock();
+        running_--;
+        idle_.notify_all();
+      }
+    }
+  }
+}
+
+}  // namespace brief
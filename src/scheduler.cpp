@@ -0,0 +1,426 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "brief/scheduler.hpp"
+#include "brief/binlog.hpp"
+#include "brief/jobserver.hpp"
+#include "brief/logger.hpp"
+#include "brief/state.hpp"
+#include "brief/trace.hpp"
+
+namespace brief {
+
+namespace {
+
+/** Usage reported by the action running on this thread. */
+thread_local Scheduler::usage_t reported;
+
+/** Index of the worker running on this thread. */
+thread_local size_t currentWorker = Scheduler::NO_WORKER;
+
+/** Interval between reads of the memory available, to keep file reads off the scheduling path. */
+constexpr std::chrono::milliseconds MEMORY_SAMPLING {100};
+
+/** Memory the system can give without swapping in KiB, 0 if unknown. */
+uint64_t availableMemory() {
+  std::ifstream src("/proc/meminfo");
+  std::string key;
+  uint64_t value;
+  std::string unit;
+  while (src >> key >> value) {
+    std::getline(src, unit);
+    if (key == "MemAvailable:")
+      return value;
+  }
+  return 0;
+}
+
+}  // namespace
+
+constexpr size_t Scheduler::NO_WORKER;
+
+Scheduler::Scheduler(Logger &_logger, size_t _jobs, BuildState *_state)
+    : logger_(_logger), jobs_(_jobs > 0 ? _jobs : std::max(1u, std::thread::hardware_concurrency())),
+      state_(_state) {
+}
+
+Scheduler::id_t Scheduler::add(const std::string &_name, Run _run, const std::vector<id_t> &_deps) {
+  action_t action;
+  action.name_ = _name;
+  action.run_ = std::move(_run);
+  return add(std::move(action), _deps);
+}
+
+Scheduler::id_t Scheduler::addAsync(const std::string &_name, RunAsync _run, const std::vector<id_t> &_deps) {
+  action_t action;
+  action.name_ = _name;
+  action.async_ = std::move(_run);
+  return add(std::move(action), _deps);
+}
+
+Scheduler::id_t Scheduler::milestone(const std::string &_name, const std::vector<id_t> &_deps) {
+  action_t action;
+  action.name_ = _name;
+  return add(std::move(action), _deps);
+}
+
+Scheduler::id_t Scheduler::add(action_t &&_action, const std::vector<id_t> &_deps) {
+  // Dependencies must be added first, so the graph can't have cycles
+  const id_t id = actions_.size();
+  for (id_t dep : _deps) {
+    if (dep >= id)
+      throw std::out_of_range("Action " + _action.name_ + " depends on an unknown action.");
+    actions_[dep].dependents_.push_back(id);
+  }
+  _action.pending_ = _deps.size();
+  actions_.push_back(std::move(_action));
+  return id;
+}
+
+void Scheduler::classify(id_t _id, const std::string &_class, uint64_t _memoryHint) {
+  actions_.at(_id).class_ = _class;
+  actions_[_id].memoryHint_ = _memoryHint;
+}
+
+size_t Scheduler::worker() {
+  return currentWorker;
+}
+
+void Scheduler::report(const usage_t &_usage) {
+  reported = _usage;
+}
+
+void Scheduler::estimate() {
+  std::vector<std::chrono::microseconds> durations(actions_.size(), std::chrono::microseconds::zero());
+  std::vector<bool> known(actions_.size(), false);
+  std::chrono::microseconds total {0};
+  size_t count = 0;
+  std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> classes;  // Memory total and count
+  for (id_t id = 0; id < actions_.size() && state_; id++) {
+    const ActionState action = state_->action(actions_[id].name_);
+    if (action.duration_ > 0) {
+      durations[id] = std::chrono::microseconds(action.duration_);
+      known[id] = true;
+      total += durations[id];
+      count++;
+    }
+    actions_[id].memory_ = action.peakMemory_;
+    if (action.peakMemory_ > 0 && !actions_[id].class_.empty()) {
+      classes[actions_[id].class_].first += action.peakMemory_;
+      classes[actions_[id].class_].second++;
+    }
+  }
+  for (action_t &action : actions_) {
+    if (action.memory_ > 0)
+      continue;
+    auto it = classes.find(action.class_);
+    if (action.memoryHint_ > 0)
+      action.memory_ = action.memoryHint_;
+    else if (it != classes.end())
+      action.memory_ = it->second.first / it->second.second;
+  }
+  const std::chrono::microseconds average =
+      count > 0 ? total / static_cast<std::chrono::microseconds::rep>(count) : std::chrono::microseconds(1);
+
+  // Dependents are added after their dependencies
+  for (id_t id = actions_.size(); id-- > 0;) {
+    action_t &action = actions_[id];
+    const bool milestone = !action.run_ && !action.async_;
+    std::chrono::microseconds next {0};
+    for (id_t dependent : action.dependents_)
+      next = std::max(next, actions_[dependent].path_);
+    action.path_ = next + (milestone ? std::chrono::microseconds::zero() : known[id] ? durations[id] : average);
+  }
+}
+
+void Scheduler::run() {
+  const auto start = std::chrono::steady_clock::now();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    estimate();
+    const uint64_t available = availableMemory();
+    available_.store(available, std::memory_order_relaxed);
+    sampled_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    memoryLimit_ = std::numeric_limits<uint64_t>::max();
+    if (memoryBudget_ > 0)
+      memoryLimit_ = memoryBudget_;
+    if (available > 0)
+      memoryLimit_ = std::min(memoryLimit_, available);
+    std::vector<id_t> roots;
+    for (id_t id = 0; id < actions_.size(); id++) {
+      if (actions_[id].pending_ == 0)
+        roots.push_back(id);
+    }
+    for (id_t id : roots) {
+      if (actions_[id].run_ || actions_[id].async_) {
+        push(id);
+      } else {
+        done_++;
+        release(id);
+      }
+    }
+  }
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < std::min(jobs_, actions_.size()); i++)
+    workers.emplace_back(&Scheduler::work, this, i);
+  for (std::thread &worker : workers)
+    worker.join();
+
+  for (; tokens_ > 0; tokens_--)
+    jobserver_->release();
+  if (error_)
+    std::rethrow_exception(error_);
+
+  if (state_) {
+    std::vector<std::string> names;
+    names.reserve(actions_.size());
+    for (const action_t &action : actions_)
+      names.push_back(action.name_);
+    const auto duration = std::chrono::steady_clock::now() - start;
+    state_->finish(names, std::chrono::duration_cast<std::chrono::microseconds>(duration));
+  }
+}
+
+bool Scheduler::lessUrgent(id_t _a, id_t _b) const {
+  return actions_[_a].path_ < actions_[_b].path_ || (actions_[_a].path_ == actions_[_b].path_ && _a > _b);
+}
+
+void Scheduler::push(id_t _id) {
+  ready_.push_back(_id);
+  std::push_heap(ready_.begin(), ready_.end(), [this](id_t _a, id_t _b) { return lessUrgent(_a, _b); });
+  measureQueue();
+}
+
+void Scheduler::setMetrics(Metrics &_metrics) {
+  instruments_.hits_ = &_metrics.counter("brief_action_cache_hits_total",
+                                         "Actions that found their outputs up to date.");
+  instruments_.misses_ = &_metrics.counter("brief_action_cache_misses_total", "Actions that did some work.");
+  instruments_.failures_ = &_metrics.counter("brief_action_failures_total", "Actions that failed.");
+  instruments_.durations_ = &_metrics.histogram("brief_action_duration_microseconds", "Wall time of actions.");
+  instruments_.ready_ = &_metrics.gauge("brief_scheduler_ready_actions", "Actions waiting for a worker.");
+  instruments_.running_ = &_metrics.gauge("brief_scheduler_running_actions", "Actions running.");
+}
+
+void Scheduler::measureQueue() {
+  if (instruments_.ready_) {
+    instruments_.ready_->set(static_cast<int64_t>(ready_.size()));
+    instruments_.running_->set(static_cast<int64_t>(running_));
+  }
+}
+
+size_t Scheduler::slots() const {
+  return jobserver_ ? 1 + tokens_ : jobs_;
+}
+
+bool Scheduler::admit(id_t &_id) {
+  // Heavy actions that don't fit are skipped, until running ones complete, unknown available memory not limiting
+  const uint64_t available = available_.load(std::memory_order_relaxed);
+  std::vector<id_t> deferred;
+  bool found = false;
+  while (!ready_.empty() && !found) {
+    std::pop_heap(ready_.begin(), ready_.end(), [this](id_t _a, id_t _b) { return lessUrgent(_a, _b); });
+    const id_t candidate = ready_.back();
+    ready_.pop_back();
+    action_t &action = actions_[candidate];
+    if (action.memory_ == 0 || reserved_ == 0
+        || (reserved_ + action.memory_ <= memoryLimit_ && (available == 0 || action.memory_ <= available))) {
+      _id = candidate;
+      found = true;
+    } else {
+      if (!action.deferred_)
+        BRIEF_SV(logger_, SCHEDULER, "Deferring " << action.name_ << ", expecting to use " << action.memory_ / 1024
+                 << "MiB.");
+      action.deferred_ = true;
+      deferred.push_back(candidate);
+    }
+  }
+  for (id_t id : deferred)
+    push(id);
+  if (found)
+    reserved_ += actions_[_id].memory_;
+  return found;
+}
+
+void Scheduler::work(size_t _worker) {
+  currentWorker = _worker;
+  if (tracer_)
+    tracer_->nameThread("Worker " + std::to_string(_worker));
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    id_t id = 0;
+    bool acquire = false;
+    changed_.wait(lock, [this, &id, &acquire]() {
+      if (error_ || done_ == actions_.size())
+        return running_ == 0 || done_ == actions_.size();
+      if (running_ >= jobs_ || ready_.empty())
+        return false;
+      if (running_ < slots())
+        return admit(id);
+      acquire = !acquiring_ && !jobserverFailed_;
+      return acquire;
+    });
+    if (done_ == actions_.size() || error_)
+      return;
+
+    // One worker waits for a jobserver token while others wait for running actions
+    if (acquire) {
+      acquiring_ = true;
+      lock.unlock();
+      bool acquired = false, failed = false;
+      try {
+        acquired = jobserver_->acquire();
+      } catch (const std::exception &e) {
+        BRIEF_SW(logger_, SCHEDULER, "Can't acquire jobserver tokens anymore: " << e.what());
+        failed = true;
+      }
+      lock.lock();
+      acquiring_ = false;
+      jobserverFailed_ = jobserverFailed_ || failed;
+      if (acquired)
+        tokens_++;
+      changed_.notify_all();
+      continue;
+    }
+
+    running_++;
+    measureQueue();
+    action_t &action = actions_[id];
+    action.start_ = std::chrono::steady_clock::now();
+    if (tracer_)
+      action.thread_ = tracer_->thread();
+    BRIEF_SD(logger_, SCHEDULER, "Running " << action.name_);
+    if (binlog_) {
+      BRIEF_BIN(*binlog_, "Start {} on worker {}, {} running, {} ready, {}KiB reserved", action.name_, _worker,
+                running_, ready_.size(), reserved_);
+    }
+    lock.unlock();
+
+    std::exception_ptr error;
+    reported = usage_t();
+    try {
+      if (action.async_) {
+        // Must not throw after calling done
+        action.async_([this, id](std::exception_ptr _error, const usage_t &_usage) {
+          sampleMemory();
+          std::lock_guard<std::mutex> doneLock(mutex_);
+          complete(id, _error, _usage);
+        });
+        lock.lock();
+        continue;
+      }
+      action.run_();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    sampleMemory();
+    lock.lock();
+    complete(id, error, reported);
+  }
+}
+
+void Scheduler::sampleMemory() {
+  const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+  int64_t last = sampled_.load(std::memory_order_relaxed);
+  if (now - last < std::chrono::duration_cast<std::chrono::steady_clock::duration>(MEMORY_SAMPLING).count())
+    return;
+
+  // A single worker reads it, the others keep the previous sample
+  if (sampled_.compare_exchange_strong(last, now, std::memory_order_relaxed))
+    available_.store(availableMemory(), std::memory_order_relaxed);
+}
+
+void Scheduler::complete(id_t _id, std::exception_ptr _error, const usage_t &_usage) {
+  const auto end = std::chrono::steady_clock::now();
+  if (tracer_) {
+    const char *cache = _error ? "failed" : _usage.upToDate_ ? "hit" : "miss";
+    tracer_->complete("action", actions_[_id].name_, actions_[_id].start_, end, actions_[_id].thread_,
+                      {{"class", actions_[_id].class_}, {"cache", cache}});
+    if (!_error)
+      tracer_->count(_usage.upToDate_ ? "Cache hits" : "Cache misses");
+  }
+  if (binlog_) {
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - actions_[_id].start_);
+    BRIEF_BIN(*binlog_, "Done {} in {}us, {}, peak {}KiB", actions_[_id].name_, duration.count(),
+              _error ? "failed" : _usage.upToDate_ ? "up to date" : "built", _usage.peakMemory_);
+  }
+  if (instruments_.durations_) {
+    instruments_.durations_->record(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - actions_[_id].start_).count());
+    (_error ? instruments_.failures_ : _usage.upToDate_ ? instruments_.hits_ : instruments_.misses_)->add();
+  }
+  running_--;
+  reserved_ -= actions_[_id].memory_;
+  done_++;
+  measureQueue();
+  if (_error) {
+    try {
+      std::rethrow_exception(_error);
+    } catch (const std::exception &e) {
+      BRIEF_SW(logger_, SCHEDULER, actions_[_id].name_ << " failed: " << e.what());
+    } catch (...) {
+      BRIEF_SW(logger_, SCHEDULER, actions_[_id].name_ << " failed.");
+    }
+    if (!error_)
+      error_ = _error;
+  } else {
+    if (state_ && !_usage.upToDate_) {
+      const auto duration = end - actions_[_id].start_;
+      state_->measure(actions_[_id].name_, std::chrono::duration_cast<std::chrono::microseconds>(duration),
+                      _usage.peakMemory_);
+    }
+    release(_id);
+  }
+
+  // Give back tokens other processes could use, and stop waiting for one if we're done
+  if (jobserver_) {
+    try {
+      for (; tokens_ > 0 && tokens_ + 1 > running_ && ready_.empty(); tokens_--)
+        jobserver_->release();
+      if (acquiring_ && (error_ || done_ == actions_.size()))
+        jobserver_->interrupt();
+    } catch (const std::exception &e) {
+      BRIEF_SW(logger_, SCHEDULER, "Can't give back jobserver tokens: " << e.what());
+    }
+  }
+  changed_.notify_all();
+}
+
+void Scheduler::release(id_t _id) {
+  for (id_t dependent : actions_[_id].dependents_) {
+    action_t &action = actions_[dependent];
+    if (--action.pending_ > 0)
+      continue;
+    if (action.run_ || action.async_) {
+      push(dependent);
+    } else {
+      done_++;
+      release(dependent);
+    }
+  }
+}
+
+}  // namespace brief
@@ -0,0 +1,143 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "brief/context.hpp"
+#include "brief/scope.hpp"
+#include "brief/template.hpp"
+
+namespace brief {
+
+Scope::Scope(Context &_ctx, const Repository &_repo, const Task &_task)
+    : ctx_(_ctx), repo_(_repo), task_(_task) {
+}
+
+std::string Scope::lookup(const std::string &_name) {
+  std::string result;
+  append(_name, result);
+  return result;
+}
+
+std::string Scope::expand(const std::string &_source) {
+  const std::shared_ptr<const Template> compiled = ctx_.templates_.get(_source);
+  if (compiled->literal())
+    return compiled->segments().empty() ? std::string() : compiled->segments().front().text_;
+  std::string result;
+  expand(*compiled, result);
+  return result;
+}
+
+void Scope::expand(const Template &_template, std::string &_dest) {
+  _dest.reserve(_dest.size() + _template.literalSize());
+  for (const Template::segment_t &segment : _template.segments()) {
+    if (segment.variable_)
+      append(segment.text_, _dest);
+    else
+      _dest += segment.text_;
+  }
+}
+
+void Scope::append(const std::string &_name, std::string &_dest) {
+  auto memo = values_.find(_name);
+  if (memo != values_.end() && valid(memo->second)) {
+    depend(memo->second.registered_);
+    _dest += memo->second.value_;
+    return;
+  }
+
+  const std::string *definition = nullptr;
+  auto symbol = task_.symbols_.find(_name);
+  if (symbol != task_.symbols_.end()) {
+    definition = &symbol->second;
+  } else {
+    auto constant = repo_.constants_.find(_name);
+    if (constant != repo_.constants_.end())
+      definition = &constant->second;
+  }
+  if (definition) {
+    for (const frame_t &frame : expanding_) {
+      if (frame.name_ != _name)
+        continue;
+      std::string cycle;
+      for (const frame_t &member : expanding_)
+        cycle += member.name_ + " -> ";
+      throw std::runtime_error("Variable references itself: " + cycle + _name);
+    }
+
+    expanding_.push_back({_name, {}});
+    value_t value;
+    try {
+      expand(*ctx_.templates_.get(*definition), value.value_);
+    } catch (...) {
+      expanding_.pop_back();
+      throw;
+    }
+    value.registered_ = std::move(expanding_.back().registered_);
+    expanding_.pop_back();
+    depend(value.registered_);
+    _dest += value.value_;
+    values_[_name] = std::move(value);
+    return;
+  }
+
+  const auto &registries = ctx_.registries();
+  auto known = registries.knownVars_.find(_name);
+  if (known != registries.knownVars_.end()) {
+    if (!expanding_.empty())
+      expanding_.back().registered_.emplace_back(_name, registries.varVersions_.at(_name));
+    _dest += known->second;
+    return;
+  }
+
+  auto prefixed = prefixed_.find(_name);
+  if (prefixed != prefixed_.end()) {
+    _dest += prefixed->second;
+    return;
+  }
+
+  size_t offset = _name.find("::");
+  if (offset != std::string::npos) {
+    auto it = registries.varPrefixes_.find(_name.substr(0, offset));
+    if (it != registries.varPrefixes_.end()) {
+      _dest += prefixed_.emplace(_name, it->second(repo_, task_, _name.substr(offset + 2))).first->second;
+      return;
+    }
+  }
+
+  throw std::runtime_error("Unknown variable: " + _name);
+}
+
+void Scope::depend(const versions_t &_registered) {
+  if (!expanding_.empty())
+    expanding_.back().registered_.insert(expanding_.back().registered_.end(), _registered.begin(), _registered.end());
+}
+
+bool Scope::valid(const value_t &_value) const {
+  if (_value.registered_.empty())
+    return true;
+  const auto &registries = ctx_.registries();
+  for (const auto &registered : _value.registered_) {
+    auto version = registries.varVersions_.find(registered.first);
+    if (version == registries.varVersions_.end() || version->second != registered.second)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace brief
@@ -0,0 +1,171 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctime>
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/state.hpp"
+#include "brief/hash.hpp"
+#include "brief/model/repository.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+constexpr uint64_t BuildState::EXPIRY;
+
+void BuildState::load(const fs::path &_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  files_.clear();
+  actions_.clear();
+  builds_ = lastDuration_ = 0;
+
+  std::ifstream src(_path.string(), std::ios::binary);
+  if (!src.is_open())
+    return;
+  try {
+    int version;
+    msgpack<int>::read(src, version);
+    if (version != BRIEF_SCHEMA_VERSION)
+      return;
+    msgpack<std::unordered_map<std::string, FileState>>::read(src, files_);
+    msgpack<std::unordered_map<std::string, ActionState>>::read(src, actions_);
+    msgpack<uint64_t>::read(src, builds_);
+    msgpack<uint64_t>::read(src, lastDuration_);
+  } catch (const std::runtime_error &) {
+    files_.clear();
+    actions_.clear();
+    builds_ = lastDuration_ = 0;
+  }
+}
+
+void BuildState::save(const fs::path &_path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fs::create_directories(_path.parent_path());
+  std::ofstream dst(_path.string(), std::ios::binary);
+  msgpack<int>::write(dst, BRIEF_SCHEMA_VERSION);
+  msgpack<std::unordered_map<std::string, FileState>>::write(dst, files_);
+  msgpack<std::unordered_map<std::string, ActionState>>::write(dst, actions_);
+  msgpack<uint64_t>::write(dst, builds_);
+  msgpack<uint64_t>::write(dst, lastDuration_);
+}
+
+uint64_t BuildState::hash(const fs::path &_file) {
+  boost::system::error_code error;
+  FileState current;
+  current.modified_ = fs::last_write_time(_file, error);
+  if (!error)
+    current.size_ = fs::file_size(_file, error);
+  if (error)
+    return 0;
+
+  const std::string key = _file.string();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(key);
+    if (it != files_.end() && it->second.modified_ == current.modified_ && it->second.size_ == current.size_)
+      return it->second.hash_;
+  }
+
+  // Hash outside of the lock, other threads might hash other files meanwhile
+  current.hash_ = hashFile(_file);
+
+  // Timestamps have a one second resolution, a file modified this second could change again unnoticed
+  if (current.modified_ < std::time(nullptr) - 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_[key] = current;
+  }
+  return current.hash_;
+}
+
+uint64_t BuildState::hash(const std::vector<fs::path> &_files) {
+  Hasher hasher;
+  for (const fs::path &file : _files) {
+    hasher.update(file.string());
+    hasher.update(hash(file));
+  }
+  return hasher.digest();
+}
+
+bool BuildState::upToDate(const std::string &_action, uint64_t _inputs, const std::vector<fs::path> &_outputs) {
+  ActionState previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = actions_.find(_action);
+    if (it == actions_.end() || it->second.inputs_ != _inputs)
+      return false;
+    previous = it->second;
+  }
+  for (const fs::path &output : _outputs) {
+    if (!fs::exists(output))
+      return false;
+  }
+  return hash(_outputs) == previous.outputs_;
+}
+
+bool BuildState::record(const std::string &_action, uint64_t _inputs, const std::vector<fs::path> &_outputs) {
+  const uint64_t outputs = hash(_outputs);
+  std::lock_guard<std::mutex> lock(mutex_);
+  ActionState &state = actions_[_action];
+  const bool changed = state.outputs_ != outputs;
+  state.inputs_ = _inputs;
+  state.outputs_ = outputs;
+  state.build_ = builds_;
+  return changed;
+}
+
+void BuildState::measure(const std::string &_action, std::chrono::microseconds _duration, uint64_t _peakMemory) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ActionState &state = actions_[_action];
+  state.duration_ = static_cast<uint64_t>(_duration.count());
+  state.peakMemory_ = _peakMemory;
+  state.build_ = builds_;
+}
+
+ActionState BuildState::action(const std::string &_action) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = actions_.find(_action);
+  return it != actions_.end() ? it->second : ActionState();
+}
+
+void BuildState::finish(const std::vector<std::string> &_actions, std::chrono::microseconds _duration) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string &action : _actions) {
+    auto it = actions_.find(action);
+    if (it != actions_.end())
+      it->second.build_ = builds_;
+  }
+  for (auto it = actions_.begin(); it != actions_.end();) {
+    if (builds_ - it->second.build_ >= EXPIRY)
+      it = actions_.erase(it);
+    else
+      ++it;
+  }
+  builds_++;
+  lastDuration_ = static_cast<uint64_t>(_duration.count());
+}
+
+std::chrono::microseconds BuildState::lastDuration() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::chrono::microseconds(lastDuration_);
+}
+
+}  // namespace brief
@@ -62,6 +62,14 @@ Task Task::merge(const Task &_task) const {
 
   BRIEF_MERGE_VALUE(optimize_)
 
+  BRIEF_MERGE_VALUE(precompileHeaders_)
+
+  BRIEF_MERGE_VALUE(unityBatch_)
+
+  BRIEF_MERGE_VALUE(unityBatchBytes_)
+
+  BRIEF_MERGE_VALUE(jobMemory_)
+
   BRIEF_MERGE_SET(sources_)
 
   BRIEF_MERGE_SET(includeDirs_)
@@ -0,0 +1,86 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <functional>
+#include <stdexcept>
+
+#include "brief/template.hpp"
+
+namespace brief {
+
+Template::Template(const std::string &_source) {
+  std::string literal;
+  size_t cursor = 0;
+  while (cursor < _source.size()) {
+    const size_t dollar = _source.find('$', cursor);
+    if (dollar == std::string::npos || dollar + 1 == _source.size()) {
+      literal.append(_source, cursor, std::string::npos);
+      break;
+    }
+    literal.append(_source, cursor, dollar - cursor);
+
+    const char next = _source[dollar + 1];
+    if (next == '$') {
+      literal += '$';
+      cursor = dollar + 2;
+    } else if (next == '{') {
+      const size_t end = _source.find('}', dollar + 2);
+      if (end == std::string::npos)
+        throw std::runtime_error("Unterminated variable in: " + _source);
+      if (end == dollar + 2)
+        throw std::runtime_error("Empty variable name in: " + _source);
+      if (!literal.empty()) {
+        literalSize_ += literal.size();
+        segments_.push_back({false, std::move(literal)});
+        literal.clear();
+      }
+      segments_.push_back({true, _source.substr(dollar + 2, end - dollar - 2)});
+      variables_++;
+      cursor = end + 1;
+    } else {
+      literal += '$';
+      cursor = dollar + 1;
+    }
+  }
+  if (!literal.empty()) {
+    literalSize_ += literal.size();
+    segments_.push_back({false, std::move(literal)});
+  }
+}
+
+constexpr size_t TemplateCache::SHARDS;
+constexpr size_t TemplateCache::CAPACITY;
+
+std::shared_ptr<const Template> TemplateCache::get(const std::string &_source) {
+  shard_t &shard = shards_[std::hash<std::string>()(_source) % SHARDS];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    auto it = shard.templates_.find(_source);
+    if (it != shard.templates_.end())
+      return it->second;
+  }
+
+  // Parsed unlocked, a thread parsing the same string meanwhile is harmless
+  auto compiled = std::make_shared<const Template>(_source);
+  std::lock_guard<std::mutex> lock(shard.mutex_);
+  if (shard.templates_.size() >= CAPACITY)
+    shard.templates_.clear();
+  return shard.templates_.emplace(_source, std::move(compiled)).first->second;
+}
+
+}  // namespace brief
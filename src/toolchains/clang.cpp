@@ -0,0 +1,568 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/AST/ASTContext.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/CodeGen/CodeGenAction.h>
+#include <clang/Driver/Compilation.h>
+#include <clang/Driver/Driver.h>
+#include <clang/Driver/Job.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Frontend/MultiplexConsumer.h>
+#include <clang/Frontend/TextDiagnosticBuffer.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "brief/toolchains/clang.hpp"
+#include "brief/context.hpp"
+#include "brief/glob.hpp"
+#include "brief/hash.hpp"
+#include "brief/toolchains/units.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr auto SOURCE_PLACEHOLDER = "__brief_source__";
+constexpr auto OBJECT_PLACEHOLDER = "__brief_object__.o";
+constexpr auto DEPFILE_PLACEHOLDER = "__brief_object__.d";
+
+std::string join(const std::vector<std::string> &_args) {
+  std::string result;
+  for (const std::string &arg : _args)
+    result += (result.empty() ? "" : " ") + arg;
+  return result;
+}
+
+std::string findProgram(const std::string &_name, const std::string &_fallback) {
+  auto found = llvm::sys::findProgramByName(_name);
+  if (found)
+    return *found;
+  found = llvm::sys::findProgramByName(_fallback);
+  if (found)
+    return *found;
+  return _name;
+}
+
+/** Fingerprints the command line of a unit and the content of what it included last time it was compiled. */
+uint64_t fingerprint(BuildState &_state, const std::vector<std::string> &_cc1, const unit_t &_unit,
+                     const fs::path &_pch) {
+  std::vector<fs::path> prerequisites = readDepfile(_unit.depfile_);
+  if (!_pch.empty())
+    prerequisites.push_back(_pch);
+  Hasher hasher;
+  for (const std::string &arg : _cc1)
+    hasher.update(arg);
+  return hasher.update(_state.hash(prerequisites)).digest();
+}
+
+/** Replaces the placeholders of a cc1 command line template with the paths of a translation unit. */
+std::vector<std::string> instantiate(const std::vector<std::string> &_template, const unit_t &_unit) {
+  std::vector<std::string> result;
+  result.reserve(_template.size());
+  for (const std::string &arg : _template) {
+    if (arg.compare(0, strlen(SOURCE_PLACEHOLDER), SOURCE_PLACEHOLDER) == 0) {
+      const bool mainFileName = !result.empty() && result.back() == "-main-file-name";
+      result.push_back(mainFileName ? _unit.source_.filename().string() : _unit.source_.string());
+    } else if (arg == OBJECT_PLACEHOLDER) {
+      result.push_back(_unit.object_.string());
+    } else if (arg == DEPFILE_PLACEHOLDER) {
+      result.push_back(_unit.depfile_.string());
+    } else {
+      result.push_back(arg);
+    }
+  }
+  return result;
+}
+
+/** What the frontend of a translation unit cost. */
+struct frontend_t {
+  std::chrono::nanoseconds duration_ {0};
+
+  /** Bytes allocated for the AST and the sources, once the whole translation unit is parsed. */
+  uint64_t memory_ = 0;
+};
+
+/** Measures the time and memory spent in the frontend, until the AST of the whole translation unit is available. */
+class FrontendProbe : public clang::ASTConsumer {
+ public:
+  explicit FrontendProbe(frontend_t &_result)
+      : start_(std::chrono::steady_clock::now()), result_(_result) {
+  }
+
+  void HandleTranslationUnit(clang::ASTContext &_context) override {
+    result_.duration_ = std::chrono::steady_clock::now() - start_;
+    const clang::SourceManager &sources = _context.getSourceManager();
+    result_.memory_ = _context.getASTAllocatedMemory() + _context.getSideTableAllocatedMemory()
+                      + sources.getContentCacheSize() + sources.getDataStructureSizes();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+  frontend_t &result_;
+};
+
+class ProbedAction : public clang::WrapperFrontendAction {
+ public:
+  ProbedAction(std::unique_ptr<clang::FrontendAction> _wrapped, frontend_t &_frontend)
+      : clang::WrapperFrontendAction(std::move(_wrapped)), frontend_(_frontend) {
+  }
+
+ protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &_compiler,
+                                                        llvm::StringRef _file) override {
+    std::vector<std::unique_ptr<clang::ASTConsumer>> consumers;
+    consumers.emplace_back(new FrontendProbe(frontend_));
+    consumers.emplace_back(clang::WrapperFrontendAction::CreateASTConsumer(_compiler, _file));
+    return std::unique_ptr<clang::ASTConsumer>(new clang::MultiplexConsumer(std::move(consumers)));
+  }
+
+ private:
+  frontend_t &frontend_;
+};
+
+/**
+ * Compiler state owned by a worker thread and reused for every translation unit it compiles,
+ * the file manager caching stats and file contents between them.
+ */
+class Worker {
+ public:
+  Worker()
+      : diagIDs_(new clang::DiagnosticIDs()), files_(new clang::FileManager(clang::FileSystemOptions())),
+        pchOperations_(std::make_shared<clang::PCHContainerOperations>()) {
+  }
+
+  /** Emits an object file, using the precompiled header *_pch* if not empty. */
+  bool compile(const std::vector<std::string> &_cc1, const fs::path &_pch, std::string &_diagnostics,
+               frontend_t &_frontend) {
+    return run(_cc1, [&_pch](clang::CompilerInvocation &_invocation) {
+      if (!_pch.empty())
+        _invocation.getPreprocessorOpts().ImplicitPCHInclude = _pch.string();
+    }, _diagnostics, _frontend);
+  }
+
+  /** Emits a precompiled header instead of an object file, from the same command line. */
+  bool precompile(const std::vector<std::string> &_cc1, std::string &_diagnostics,
+                  frontend_t &_frontend) {
+    return run(_cc1, [](clang::CompilerInvocation &_invocation) {
+      clang::FrontendOptions &options = _invocation.getFrontendOpts();
+      options.ProgramAction = clang::frontend::GeneratePCH;
+      for (clang::FrontendInputFile &input : options.Inputs)
+        input = clang::FrontendInputFile(input.getFile(), input.getKind().getHeader());
+    }, _diagnostics, _frontend);
+  }
+
+ private:
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> diagIDs_;
+  llvm::IntrusiveRefCntPtr<clang::FileManager> files_;
+  std::shared_ptr<clang::PCHContainerOperations> pchOperations_;
+
+  /** Runs a cc1 command line, returns false on errors, *_diagnostics* being filled in any case. */
+  bool run(const std::vector<std::string> &_cc1, const std::function<void(clang::CompilerInvocation&)> &_customize,
+           std::string &_diagnostics, frontend_t &_frontend) {
+    std::vector<const char*> argv;
+    argv.reserve(_cc1.size());
+    for (const std::string &arg : _cc1) {
+      if (arg != "-cc1")
+        argv.push_back(arg.c_str());
+    }
+
+    auto *argsBuffer = new clang::TextDiagnosticBuffer();
+    llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> argsOptions = new clang::DiagnosticOptions();
+    clang::DiagnosticsEngine argsDiags(diagIDs_, &*argsOptions, argsBuffer);
+    auto invocation = std::make_shared<clang::CompilerInvocation>();
+    const bool parsed = clang::CompilerInvocation::CreateFromArgs(*invocation, argv, argsDiags);
+    invocation->getFrontendOpts().DisableFree = false;  // We're not exiting after this TU
+    _customize(*invocation);
+
+    llvm::raw_string_ostream diagStream(_diagnostics);
+    clang::CompilerInstance compiler(pchOperations_);
+    compiler.setInvocation(invocation);
+    compiler.setFileManager(files_.get());
+    compiler.createDiagnostics(new clang::TextDiagnosticPrinter(diagStream, &compiler.getDiagnosticOpts()));
+    argsBuffer->FlushDiagnostics(compiler.getDiagnostics());
+
+    bool success = false;
+    if (parsed) {
+      std::unique_ptr<clang::FrontendAction> action;
+      if (invocation->getFrontendOpts().ProgramAction == clang::frontend::GeneratePCH)
+        action.reset(new clang::GeneratePCHAction());
+      else
+        action.reset(new clang::EmitObjAction());
+      ProbedAction probed(std::move(action), _frontend);
+      success = compiler.ExecuteAction(probed);
+    }
+    diagStream.flush();
+    return success;
+  }
+};
+
+/** Workers of a task build, one per scheduler thread, created on first use. */
+class Workers {
+ public:
+  Worker &get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Worker> &worker = workers_[std::this_thread::get_id()];
+    if (!worker)
+      worker.reset(new Worker());
+    return *worker;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::thread::id, std::unique_ptr<Worker>> workers_;
+};
+
+/**
+ * Generates, if outdated, a precompiled header of the includes shared by most sources of the most common language.
+ * Returns its path and sets *_extension* to the one of the sources using it, or returns an empty path.
+ */
+fs::path precompile(Logger &_logger, const std::vector<unit_t> &_units,
+                    const std::map<std::string, std::vector<std::string>> &_templates, const fs::path &_output,
+                    std::string &_extension) {
+  std::map<std::string, std::vector<const unit_t*>> languages;
+  for (const unit_t &unit : _units)
+    languages[unit.source_.extension().string()].push_back(&unit);
+  auto language = std::max_element(languages.begin(), languages.end(), [](const auto &_a, const auto &_b) {
+    return _a.second.size() < _b.second.size();
+  });
+
+  const std::string prelude = makePrelude(language->second);
+  if (prelude.empty()) {
+    BRIEF_V(_logger, "No header included by enough sources to be worth precompiling.");
+    return fs::path();
+  }
+
+  // Only rewrite the prelude if it changed, to keep its timestamp
+  const fs::path dir = _output / "pch";
+  const unit_t pch {dir / "prelude.h", dir / "prelude.h.pch", dir / "prelude.h.d"};
+  fs::create_directories(dir);
+  std::ifstream previous(pch.source_.string());
+  if (std::string((std::istreambuf_iterator<char>(previous)), std::istreambuf_iterator<char>()) != prelude) {
+    std::ofstream dst(pch.source_.string());
+    dst << prelude;
+  }
+
+  const std::vector<std::string> cc1 = instantiate(_templates.at(language->first), pch);
+  _extension = language->first;
+  if (isPrecompiled(prelude, cc1, pch)) {
+    Scheduler::report({0, true});
+    return pch.object_;
+  }
+
+  BRIEF_V(_logger, "Precompiling headers for " << language->second.size() << " sources:\n" << prelude);
+  Worker worker;
+  std::string diagnostics;
+  frontend_t frontend;
+  if (!worker.precompile(cc1, diagnostics, frontend)) {
+    BRIEF_W(_logger, "Can't precompile headers, building without them:\n" << diagnostics);
+    fs::remove(pch.object_);
+    _extension.clear();
+    return fs::path();
+  }
+
+  recordPrecompiled(prelude, cc1, pch);
+  Scheduler::report({(frontend.memory_ + 1023) / 1024});
+  return pch.object_;
+}
+
+/** State shared by the actions building a task. */
+struct build_t {
+  std::vector<unit_t> units_;
+  std::map<std::string, std::vector<std::string>> templates_;
+  fs::path pch_;
+  std::string pchExtension_;
+  Workers workers_;
+  std::atomic<size_t> compiled_ {0}, unchanged_ {0};
+  std::vector<frontend_t> frontend_;
+};
+
+}  // namespace
+
+ClangToolchain::ClangToolchain(Context &_ctx)
+    : ctx_(_ctx), clang_(findProgram("clang", "clang-" + std::to_string(LLVM_VERSION_MAJOR))),
+      clangxx_(findProgram("clang++", "clang++-" + std::to_string(LLVM_VERSION_MAJOR))),
+      ar_(findProgram("ar", "llvm-ar")) {
+  static std::once_flag targetsInitialized;
+  std::call_once(targetsInitialized, []() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+  });
+}
+
+std::vector<std::string> ClangToolchain::compileFlags(const Task &_task, const std::vector<std::string> &_flavors,
+                                                      const std::vector<fs::path> &_includeDirs) const {
+  std::vector<std::string> flags;
+  if (!_task.standard_.empty())
+    flags.push_back("-std=" + _task.standard_);
+
+  switch (_task.optimize_) {
+    case Task::optimisation_t::NONE: flags.push_back("-O0"); break;
+    case Task::optimisation_t::SIZE: flags.push_back("-Os"); break;
+    case Task::optimisation_t::SPEED: flags.push_back("-O2"); break;
+  }
+
+  if (std::find(_flavors.begin(), _flavors.end(), "debug") != _flavors.end())
+    flags.push_back("-g");
+
+  for (const fs::path &dir : _includeDirs)
+    flags.push_back("-I" + dir.string());
+
+  for (const auto &symbol : _task.symbols_)
+    flags.push_back("-D" + symbol.first + (symbol.second.empty() ? "" : "=" + symbol.second));
+
+  flags.insert(flags.end(), _task.toolchainFlags_.begin(), _task.toolchainFlags_.end());
+  return flags;
+}
+
+std::vector<std::string> ClangToolchain::cc1Template(const std::vector<std::string> &_flags,
+                                                     const std::string &_extension) const {
+  const std::string source = SOURCE_PLACEHOLDER + _extension;
+  std::vector<const char*> argv {clang_.c_str(), "-c", source.c_str(), "-o", OBJECT_PLACEHOLDER,
+                                 "-MD", "-MF", DEPFILE_PLACEHOLDER};
+  for (const std::string &flag : _flags)
+    argv.push_back(flag.c_str());
+
+  auto *buffer = new clang::TextDiagnosticBuffer();
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> options = new clang::DiagnosticOptions();
+  clang::DiagnosticsEngine diags(new clang::DiagnosticIDs(), &*options, buffer);
+  clang::driver::Driver driver(clang_, llvm::sys::getDefaultTargetTriple(), diags);
+  driver.setCheckInputsExist(false);
+
+  std::unique_ptr<clang::driver::Compilation> compilation(driver.BuildCompilation(argv));
+  if (!compilation || diags.hasErrorOccurred() || compilation->getJobs().size() != 1) {
+    std::string message = "Clang driver can't compile " + _extension + " files with flags " + join(_flags);
+    for (auto it = buffer->err_begin(); it != buffer->err_end(); ++it)
+      message += "\n" + it->second;
+    throw std::runtime_error(message);
+  }
+
+  const clang::driver::Command &command = *compilation->getJobs().begin();
+  std::vector<std::string> result;
+  for (const char *arg : command.getArguments()) {
+    if (std::string(arg) != "-disable-free")
+      result.emplace_back(arg);
+  }
+  return result;
+}
+
+void ClangToolchain::link(const std::vector<std::string> &_args, Scheduler::Done _done) const {
+  Logger &logger = ctx_.logger_;
+  const std::string command = join(_args);
+  ctx_.spawner_.spawn(_args, [&logger, command, _done](const process_result_t &_result) {
+    if (_result.status_ != 0) {
+      _done(std::make_exception_ptr(std::runtime_error("Link failed (" + std::to_string(_result.status_) + "): "
+                                                       + command + "\n" + _result.output_)),
+            {_result.peakMemory_});
+      return;
+    }
+    if (!_result.output_.empty())
+      BRIEF_W(logger, _result.output_);
+    _done(nullptr, {_result.peakMemory_});
+  });
+}
+
+Toolchain::plan_t ClangToolchain::plan(Scheduler &_scheduler, const std::string &_name, const Task &_task,
+                                       const std::vector<std::string> &_flavors,
+                                       const std::vector<plan_t> &_dependencies) {
+  const fs::path &root = ctx_.builder_.root();
+  const fs::path output = ctx_.builder_.outputDir(_name, _flavors);
+
+  // Own include dirs come first, static libraries must come before the ones they depend on
+  plan_t result;
+  std::vector<Scheduler::id_t> interfaces, outputs;
+  for (const std::string &dir : _task.includeDirs_)
+    result.includeDirs_.push_back(root / dir);
+  if (_task.type_ == Task::type_t::LIBRARY)
+    result.libraries_.push_back(output / ("lib" + _name + ".a"));
+  for (const plan_t &dependency : _dependencies) {
+    interfaces.push_back(dependency.interface_);
+    outputs.push_back(dependency.output_);
+    for (const fs::path &dir : dependency.includeDirs_) {
+      if (std::find(result.includeDirs_.begin(), result.includeDirs_.end(), dir) == result.includeDirs_.end())
+        result.includeDirs_.push_back(dir);
+    }
+    for (const fs::path &library : dependency.libraries_) {
+      result.libraries_.erase(std::remove(result.libraries_.begin(), result.libraries_.end(), library),
+                              result.libraries_.end());
+      result.libraries_.push_back(library);
+    }
+  }
+  // Headers are in the source tree, they are ready once the ones they might include are
+  result.interface_ = _scheduler.milestone(_name + " interface", interfaces);
+
+  Logger &logger = ctx_.logger_;
+  BuildState &state = ctx_.builder_.state();
+  const uint64_t memoryHint = static_cast<uint64_t>(_task.jobMemory_) * 1024;
+  auto build = std::make_shared<build_t>();
+  const std::vector<std::string> flags = compileFlags(_task, _flavors, result.includeDirs_);
+  for (const std::string &pattern : _task.sources_) {
+    for (const fs::path &source : glob(root, pattern)) {
+      const fs::path object = output / "obj" / (source.string() + ".o");
+      build->units_.push_back({root / source, object, fs::path(object).replace_extension(".d")});
+      const std::string extension = source.extension().string();
+      if (build->templates_.find(extension) == build->templates_.end())
+        build->templates_.emplace(extension, cc1Template(flags, extension));
+    }
+  }
+
+  // Sources and precompiled headers only wait for the headers of dependencies, not for their libraries
+  std::vector<Scheduler::id_t> compileDeps = interfaces;
+  if (_task.precompileHeaders_ && !build->units_.empty()) {
+    const std::vector<unit_t> units = build->units_;
+    const Scheduler::id_t pch = _scheduler.add("Precompile " + (output / "pch").string(), [&logger, build, units,
+                                                                                       output]() {
+      build->pch_ = precompile(logger, units, build->templates_, output, build->pchExtension_);
+    }, interfaces);
+    _scheduler.classify(pch, "precompile", memoryHint);
+    compileDeps.push_back(pch);
+  }
+
+  if ((_task.unityBatch_ > 0 || _task.unityBatchBytes_ > 0) && !build->units_.empty())
+    build->units_ = makeBatches(logger, build->units_, _task, root, output);
+  build->frontend_.assign(build->units_.size(), frontend_t());
+
+  std::vector<Scheduler::id_t> linkDeps = outputs;
+  for (size_t i = 0; i < build->units_.size(); i++) {
+    const std::string name = "Compile " + build->units_[i].object_.string();
+    const Scheduler::id_t compile = _scheduler.add(name, [&logger, &state, build, i, name]() {
+      const unit_t &unit = build->units_[i];
+      const std::string extension = unit.source_.extension().string();
+      const fs::path &unitPch = extension == build->pchExtension_ ? build->pch_ : fs::path();
+      const std::vector<std::string> cc1 = instantiate(build->templates_.at(extension), unit);
+      if (fs::exists(unit.depfile_) && state.upToDate(name, fingerprint(state, cc1, unit, unitPch), {unit.object_})) {
+        Scheduler::report({0, true});
+        return;
+      }
+      fs::create_directories(unit.object_.parent_path());
+      std::string diagnostics;
+      const bool success = build->workers_.get().compile(cc1, unitPch, diagnostics, build->frontend_[i]);
+      build->compiled_++;
+      if (!success)
+        throw std::runtime_error(unit.source_.string() + ":\n" + diagnostics);
+      if (!diagnostics.empty())
+        BRIEF_W(logger, unit.source_.string() + ":\n" + diagnostics);
+
+      // An identical object doesn't need to be relinked
+      if (!state.record(name, fingerprint(state, cc1, unit, unitPch), {unit.object_}))
+        build->unchanged_++;
+      Scheduler::report({(build->frontend_[i].memory_ + 1023) / 1024});
+    }, compileDeps);
+    _scheduler.classify(compile, "compile", memoryHint);
+    linkDeps.push_back(compile);
+  }
+
+  // Link through a subprocess, only if the content of an object or a library changed
+  fs::path binary;
+  std::vector<std::string> args;
+  if (_task.type_ == Task::type_t::APPLICATION) {
+    binary = output / _name;
+    args = {clangxx_, "-o", binary.string()};
+  } else if (_task.type_ == Task::type_t::LIBRARY) {
+    binary = result.libraries_.front();
+    args = {ar_, "rcs", binary.string()};
+  } else {
+    throw std::runtime_error("Clang toolchain can only build lib and app tasks, " + _name + " is neither.");
+  }
+  std::vector<fs::path> inputs;
+  for (const unit_t &unit : build->units_)
+    inputs.push_back(unit.object_);
+  if (_task.type_ == Task::type_t::APPLICATION)
+    inputs.insert(inputs.end(), result.libraries_.begin(), result.libraries_.end());
+  for (const fs::path &input : inputs)
+    args.push_back(input.string());
+
+  const std::string linkName = "Link " + binary.string();
+  const Scheduler::id_t link = _scheduler.addAsync(linkName, [this, &state, _name, linkName, build, binary, inputs,
+                                                              args](Scheduler::Done _done) {
+    const size_t compiled = build->compiled_;
+    BRIEF_V(ctx_.logger_, "Task " << _name << ": compiled " << compiled << " of " << build->units_.size()
+                          << " units, " << build->unchanged_ << " into identical objects.");
+    if (compiled > 0) {
+      Metrics::Histogram &frontends = ctx_.metrics_.histogram("brief_frontend_duration_microseconds",
+                                                              "Time to parse a translation unit.");
+      std::chrono::nanoseconds total = std::chrono::nanoseconds::zero();
+      for (size_t i = 0; i < build->units_.size(); i++) {
+        if (build->frontend_[i].duration_ != std::chrono::nanoseconds::zero()) {
+          BRIEF_D(ctx_.logger_, "Frontend time of " << build->units_[i].source_ << ": "
+                                << build->frontend_[i].duration_);
+          frontends.record(std::chrono::duration_cast<std::chrono::microseconds>(build->frontend_[i].duration_)
+                           .count());
+        }
+        total += build->frontend_[i].duration_;
+      }
+      BRIEF_V(ctx_.logger_, "Task " << _name << ": average frontend time per unit " << (total / compiled)
+                            << (build->pch_.empty() ? " without" : " with") << " precompiled header.");
+    }
+
+    Hasher hasher;
+    for (const std::string &arg : args)
+      hasher.update(arg);
+    const uint64_t fingerprint = hasher.update(state.hash(inputs)).digest();
+    if (state.upToDate(linkName, fingerprint, {binary})) {
+      _done(nullptr, {0, true});
+      return;
+    }
+    fs::remove(binary);
+    link(args, [&state, linkName, binary, fingerprint, _done](std::exception_ptr _error,
+                                                              const Scheduler::usage_t &_usage) {
+      if (!_error)
+        state.record(linkName, fingerprint, {binary});
+      _done(_error, _usage);
+    });
+  }, linkDeps);
+  _scheduler.classify(link, "link", memoryHint);
+
+  result.output_ = _scheduler.milestone(_name + " output", {link});
+  return result;
+}
+
+void ClangToolchain::test(const std::string &_name, const Task &_task) {
+  throw std::runtime_error("Clang toolchain can't test tasks yet.");
+}
+
+void ClangToolchain::install(const std::string &_name, const Task &_task) {
+  throw std::runtime_error("Clang toolchain can't install tasks yet.");
+}
+
+}  // namespace brief
@@ -0,0 +1,299 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cctype>
+#include <cstdint>
+#include <ctime>
+
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "brief/model/task.hpp"
+#include "brief/toolchains/units.hpp"
+#include "brief/glob.hpp"
+#include "brief/hash.hpp"
+#include "brief/logger.hpp"
+
+namespace brief {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+/** Share of the sources that must include a header for it to be precompiled. */
+constexpr auto PCH_MIN_SHARE = 0.5;
+
+/** Spreads the bits of a FNV-1a digest, whose low bits only depend on the low bits of the input bytes, so that it
+ * can be taken modulo a batch size (finalizer of splitmix64). */
+uint64_t mix(uint64_t _hash) {
+  _hash = (_hash ^ (_hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  _hash = (_hash ^ (_hash >> 27)) * 0x94d049bb133111ebULL;
+  return _hash ^ (_hash >> 31);
+}
+
+/** Lists the headers a source includes outside of conditional blocks, quoted ones being resolved if possible. */
+std::vector<std::string> scanIncludes(const fs::path &_source) {
+  std::ifstream src(_source.string());
+  std::vector<std::string> result;
+  int depth = 0;
+  std::string line;
+  while (std::getline(src, line)) {
+    size_t cur = line.find_first_not_of(" \t");
+    if (cur == std::string::npos || line[cur] != '#')
+      continue;
+    cur = line.find_first_not_of(" \t", cur + 1);
+    if (cur == std::string::npos)
+      continue;
+
+    if (line.compare(cur, 2, "if") == 0) {
+      depth++;
+    } else if (line.compare(cur, 5, "endif") == 0) {
+      depth--;
+    } else if (depth == 0 && line.compare(cur, 7, "include") == 0) {
+      const size_t open = line.find_first_of("<\"", cur + 7);
+      if (open == std::string::npos || line.find_first_not_of(" \t", cur + 7) != open)
+        continue;
+      const size_t close = line.find(line[open] == '<' ? '>' : '"', open + 1);
+      if (close == std::string::npos)
+        continue;
+      const std::string name = line.substr(open + 1, close - open - 1);
+      const fs::path local = _source.parent_path() / name;
+      if (line[open] == '<')
+        result.push_back('<' + name + '>');
+      else if (fs::exists(local))
+        result.push_back('"' + fs::canonical(local).string() + '"');
+      else
+        result.push_back('"' + name + '"');
+    }
+  }
+  return result;
+}
+
+/** Hashes everything a precompiled header depends on: the prelude, the command line and the included headers. */
+uint64_t hashPrecompiled(const std::string &_prelude, const std::vector<std::string> &_cc1, const unit_t &_pch) {
+  Hasher hasher;
+  hasher.update(_prelude);
+  for (const std::string &arg : _cc1)
+    hasher.update(arg);
+  if (fs::exists(_pch.depfile_)) {
+    for (const fs::path &header : readDepfile(_pch.depfile_)) {
+      hasher.update(header.string());
+      hasher.update(fs::exists(header) ? hashFile(header) : 0);
+    }
+  }
+  return hasher.digest();
+}
+
+fs::path hashPath(const unit_t &_pch) {
+  return _pch.source_.string() + ".hash";
+}
+
+}  // namespace
+
+std::vector<std::vector<const unit_t*>> chunk(const std::vector<const unit_t*> &_units, const Task &_task,
+                                              const fs::path &_root) {
+  std::vector<std::vector<const unit_t*>> batches(1);
+  uint64_t bytes = 0;
+  for (const unit_t *unit : _units) {
+    batches.back().push_back(unit);
+    const uint64_t size = fs::file_size(unit->source_);
+    const uint64_t hash = mix(Hasher().update(unit->source_.string().substr(_root.string().size())).digest());
+    bytes += size;
+    bool last;
+    if (_task.unityBatchBytes_ > 0)
+      last = hash % _task.unityBatchBytes_ < size || bytes >= 4ULL * _task.unityBatchBytes_;
+    else
+      last = hash % _task.unityBatch_ == 0 || batches.back().size() >= 4ULL * _task.unityBatch_;
+    if (last) {
+      batches.emplace_back();
+      bytes = 0;
+    }
+  }
+  if (batches.back().empty())
+    batches.pop_back();
+  return batches;
+}
+
+std::vector<unit_t> makeBatches(Logger &_logger, const std::vector<unit_t> &_units, const Task &_task,
+                                const fs::path &_root, const fs::path &_output) {
+  const fs::path dir = _output / "unity";
+  const fs::path detachedPath = dir / "detached";
+  fs::create_directories(dir);
+
+  std::set<std::string> detached;
+  if (!glob(dir, "*.o").empty()) {
+    std::ifstream src(detachedPath.string());
+    for (std::string line; std::getline(src, line);)
+      detached.insert(line);
+  }
+
+  std::vector<unit_t> result;
+  std::set<std::string> names;
+  auto plan = [&](bool _detach) {
+    result.clear();
+    names.clear();
+    std::map<std::string, std::vector<const unit_t*>> languages;
+    for (const unit_t &unit : _units)
+      languages[unit.source_.extension().string()].push_back(&unit);
+
+    bool changed = false;
+    for (const auto &language : languages) {
+      for (const auto &members : chunk(language.second, _task, _root)) {
+        Hasher hasher;
+        std::vector<const unit_t*> attached;
+        for (const unit_t *member : members) {
+          hasher.update(member->source_.string());
+          if (detached.count(member->source_.string()))
+            result.push_back(*member);
+          else
+            attached.push_back(member);
+        }
+        if (attached.size() <= 1) {
+          for (const unit_t *member : attached)
+            result.push_back(*member);
+          continue;
+        }
+
+        std::stringstream name;
+        name << "batch-" << std::hex << std::setw(16) << std::setfill('0') << hasher.digest() << language.first;
+        const unit_t batch {dir / name.str(), dir / (name.str() + ".o"), dir / (name.str() + ".d")};
+
+        if (_detach && fs::exists(batch.object_)) {
+          const std::time_t built = fs::last_write_time(batch.object_);
+          for (const unit_t *member : attached) {
+            if (fs::last_write_time(member->source_) > built) {
+              BRIEF_V(_logger, "Detaching " << member->source_ << " from its unity batch.");
+              changed = detached.insert(member->source_.string()).second || changed;
+            }
+          }
+        }
+
+        // Members are included from the batch directory, by absolute path
+        std::stringstream content;
+        content << "// Unity batch generated by brief\n";
+        for (const unit_t *member : attached)
+          content << "#include \"" << fs::absolute(member->source_).string() << "\"\n";
+        std::string previous;
+        if (fs::exists(batch.source_)) {
+          std::ifstream src(batch.source_.string());
+          previous.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+        }
+        if (previous != content.str()) {
+          std::ofstream dst(batch.source_.string());
+          dst << content.str();
+        }
+        names.insert(name.str());
+        result.push_back(batch);
+      }
+    }
+    return changed;
+  };
+  if (plan(true))
+    plan(false);
+
+  std::ofstream dst(detachedPath.string());
+  for (const std::string &source : detached)
+    dst << source << '\n';
+
+  // Remove batches no longer in use
+  for (fs::directory_iterator file(dir), end; file != end; ++file) {
+    const std::string filename = file->path().filename().string();
+    if (filename.compare(0, 6, "batch-") == 0 && !names.count(file->path().stem().string())
+        && !names.count(filename))
+      fs::remove(file->path());
+  }
+  return result;
+}
+
+std::vector<fs::path> readDepfile(const fs::path &_depfile) {
+  std::ifstream src(_depfile.string());
+  const std::string content((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  std::vector<fs::path> result;
+
+  const size_t colon = content.find(": ");
+  if (colon == std::string::npos)
+    return result;
+
+  std::string current;
+  auto flush = [&result, &current]() {
+    if (!current.empty())
+      result.emplace_back(current);
+    current.clear();
+  };
+  for (size_t i = colon + 1; i < content.size(); i++) {
+    const char c = content[i];
+    const char next = i + 1 < content.size() ? content[i + 1] : '\0';
+    if (c == '\\' && (next == '\n' || next == '\r')) {
+      flush();
+      i++;
+    } else if (c == '\\' && (next == ' ' || next == '#' || next == '\\')) {
+      current.push_back(next);
+      i++;
+    } else if (c == '$' && next == '$') {
+      current.push_back('$');
+      i++;
+    } else if (isspace(c)) {
+      flush();
+    } else {
+      current.push_back(c);
+    }
+  }
+  flush();
+  return result;
+}
+
+std::string makePrelude(const std::vector<const unit_t*> &_units) {
+  std::map<std::string, size_t> counts;
+  std::vector<std::string> order;
+  for (const unit_t *unit : _units) {
+    std::set<std::string> seen;
+    for (const std::string &include : scanIncludes(unit->source_)) {
+      if (seen.insert(include).second && counts[include]++ == 0)
+        order.push_back(include);
+    }
+  }
+
+  std::string prelude;
+  for (const std::string &include : order) {
+    const size_t count = counts[include];
+    if (count >= 2 && count >= PCH_MIN_SHARE * _units.size())
+      prelude += "#include " + include + "\n";
+  }
+  return prelude;
+}
+
+bool isPrecompiled(const std::string &_prelude, const std::vector<std::string> &_cc1, const unit_t &_pch) {
+  uint64_t stored = 0;
+  std::ifstream src(hashPath(_pch).string());
+  src >> stored;
+  return fs::exists(_pch.object_) && stored == hashPrecompiled(_prelude, _cc1, _pch);
+}
+
+void recordPrecompiled(const std::string &_prelude, const std::vector<std::string> &_cc1, const unit_t &_pch) {
+  std::ofstream dst(hashPath(_pch).string());
+  dst << hashPrecompiled(_prelude, _cc1, _pch);
+}
+
+}  // namespace brief
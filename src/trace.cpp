@@ -0,0 +1,139 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include "brief/json.hpp"
+#include "brief/trace.hpp"
+
+namespace brief {
+
+Tracer::Span::Span(Tracer &_tracer, const std::string &_category, const std::string &_name)
+    : tracer_(_tracer) {
+  if (tracer_.enabled()) {
+    category_ = _category;
+    name_ = _name;
+    start_ = Clock::now();
+  }
+}
+
+Tracer::Span::~Span() {
+  if (tracer_.enabled())
+    tracer_.complete(category_, name_, start_, Clock::now(), tracer_.thread(), args_);
+}
+
+void Tracer::Span::arg(const std::string &_name, const std::string &_value) {
+  if (tracer_.enabled())
+    args_.emplace_back(_name, _value);
+}
+
+Tracer::Tracer() : origin_(Clock::now()) {
+}
+
+Tracer::~Tracer() {
+  if (!enabled())
+    return;
+  try {
+    flush();
+  } catch (const std::exception &) {
+    // Tracing is best effort
+  }
+}
+
+void Tracer::open(const boost::filesystem::path &_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  path_ = _path;
+  origin_ = Clock::now();
+  threadLocked();
+}
+
+void Tracer::complete(const std::string &_category, const std::string &_name, Clock::time_point _start,
+                      Clock::time_point _end, int _thread, const args_t &_args) {
+  if (!enabled())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.push_back({'X', _category, _name, since(_start), since(_end) - since(_start), _thread, _args});
+}
+
+void Tracer::count(const std::string &_name, int64_t _delta) {
+  if (!enabled())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int64_t value = counters_[_name] += _delta;
+  events_.push_back({'C', "counter", _name, since(Clock::now()), 0, 0, {{"value", std::to_string(value)}}});
+}
+
+int Tracer::thread() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return threadLocked();
+}
+
+void Tracer::nameThread(const std::string &_name) {
+  if (!enabled())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.push_back({'M', "", "thread_name", 0, 0, threadLocked(), {{"name", _name}}});
+}
+
+void Tracer::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream dst(path_.string());
+  if (!dst)
+    throw std::runtime_error("Can't write trace " + path_.string());
+
+  const int pid = getpid();
+  dst << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const event_t &event : events_) {
+    dst << (first ? "\n" : ",\n") << "{\"ph\":\"" << event.phase_ << "\",\"pid\":" << pid
+        << ",\"tid\":" << event.thread_ << ",\"ts\":" << event.timestamp_;
+    if (event.phase_ == 'X')
+      dst << ",\"dur\":" << event.duration_;
+    if (!event.category_.empty())
+      dst << ",\"cat\":\"" << json_escape(event.category_) << '"';
+    dst << ",\"name\":\"" << json_escape(event.name_) << '"';
+    if (!event.args_.empty()) {
+      dst << ",\"args\":{";
+      for (size_t i = 0; i < event.args_.size(); i++) {
+        dst << (i ? "," : "") << '"' << json_escape(event.args_[i].first) << "\":";
+        // Counters only plot numbers
+        if (event.phase_ == 'C')
+          dst << event.args_[i].second;
+        else
+          dst << '"' << json_escape(event.args_[i].second) << '"';
+      }
+      dst << '}';
+    }
+    dst << '}';
+    first = false;
+  }
+  dst << "\n]}\n";
+}
+
+int64_t Tracer::since(Clock::time_point _time) const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(_time - origin_).count();
+}
+
+int Tracer::threadLocked() {
+  return threads_.emplace(std::this_thread::get_id(), static_cast<int>(threads_.size())).first->second;
+}
+
+}  // namespace brief
@@ -16,11 +16,732 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
 #include "brief/trunks.hpp"
+#include "brief/context.hpp"
+#include "brief/git.hpp"
+#include "brief/hash.hpp"
+#include "brief/model/repository.hpp"
 
 namespace brief {
 
-Trunks::Trunks(Context &_ctx) {
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr char INDEX_MAGIC[8] = {'B', 'R', 'I', 'E', 'F', 'I', 'D', 'X'};
+constexpr char PACK_MAGIC[8] = {'B', 'R', 'I', 'E', 'F', 'P', 'A', 'K'};
+
+struct index_header_t {
+  char magic_[8];
+  uint32_t version_;
+
+  /** Number of slots, a power of two. */
+  uint32_t capacity_;
+  uint64_t count_;
+
+  /** Size of the pack the index was written for, a smaller pack being another one. */
+  uint64_t packSize_;
+};
+
+constexpr size_t PACK_HEADER = sizeof(PACK_MAGIC) + sizeof(int32_t);
+
+constexpr int FETCH_ATTEMPTS = 3;
+
+/** Reads a task in place. */
+class MemoryBuffer : public std::streambuf {
+ public:
+  MemoryBuffer(const char *_begin, const char *_end) {
+    char *begin = const_cast<char*>(_begin);
+    setg(begin, begin, begin + (_end - _begin));
+  }
+};
+
+/** Holds a flock on a file, created if missing. Doesn't lock if the file can't be opened, unless *_required*. */
+class FileLock {
+ public:
+  FileLock(const fs::path &_path, int _operation, bool _required) {
+    fd_ = ::open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    int result = -1;
+    if (fd_ >= 0) {
+      do {
+        result = flock(fd_, _operation);
+      } while (result != 0 && errno == EINTR);
+    }
+    if (result != 0 && _required)
+      throw std::runtime_error("Can't lock " + _path.string() + ": " + strerror(errno));
+  }
+
+  ~FileLock() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+ private:
+  int fd_;
+};
+
+uint64_t hashKey(const std::string &_export, const std::string &_tag) {
+  return Hasher().update(_export).update(_tag).digest();
+}
+
+void writeString(std::ostream &_dst, const std::string &_value) {
+  const auto size = static_cast<uint32_t>(_value.size());
+  _dst.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  _dst.write(_value.data(), _value.size());
+}
+
+/** Task with the tasks it inherits from merged in, the task overriding them. */
+Task inherit(const Repository &_repo, const Task &_task, std::set<std::string> &_visiting) {
+  if (_task.inherits_.empty())
+    return _task;
+  if (!_visiting.insert(_task.inherits_).second)
+    throw std::runtime_error("Inheritance cycle through task " + _task.inherits_);
+  auto parent = _repo.tasks_.find(_task.inherits_);
+  if (parent == _repo.tasks_.end()) {
+    parent = _repo.exports_.find(_task.inherits_);
+    if (parent == _repo.exports_.end())
+      throw std::runtime_error("Unknown inherited task: " + _task.inherits_);
+  }
+  Task merged = inherit(_repo, parent->second, _visiting).merge(_task);
+  merged.inherits_.clear();
+  return merged;
+}
+
+/** Directory of an upstream in the trunks, readable and unique per url. */
+std::string upstreamName(const std::string &_url) {
+  std::string name = _url;
+  while (!name.empty() && name.back() == '/')
+    name.pop_back();
+  name = name.substr(name.find_last_of("/:") + 1);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".git") == 0)
+    name.resize(name.size() - 4);
+  for (char &c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.')
+      c = '_';
+  }
+  std::ostringstream result;
+  result << name << '-' << std::hex << (Hasher().update(_url).digest() >> 32);
+  return result.str();
+}
+
+/** Description at the root of a checkout, a *.brief file rather than a *.json one. */
+fs::path findDescription(const fs::path &_dir) {
+  fs::path json;
+  for (auto file : fs::directory_iterator(_dir)) {
+    if (file.path().extension() == ".brief")
+      return file.path();
+    if (file.path().extension() == ".json" && json.empty())
+      json = file.path();
+  }
+  if (json.empty())
+    throw std::runtime_error("No repo description in " + _dir.string());
+  return json;
+}
+
+/** Revision named by a tag of a description, the tag itself if the description doesn't name it. */
+std::string revision(const Repository &_repo, const std::string &_tag) {
+  const auto tag = _repo.tags_.find(_tag);
+  if (tag == _repo.tags_.end())
+    return _tag;
+  const Tag &rev = tag->second;
+  return !rev.id_.empty() ? rev.id_ : !rev.tag_.empty() ? rev.tag_ : rev.branch_;
+}
+
+/** Calls *_operation* again when it throws, up to FETCH_ATTEMPTS times. */
+template<typename Operation>
+auto retry(Logger &_logger, Operation _operation) -> decltype(_operation()) {
+  for (int attempt = 1;; attempt++) {
+    try {
+      return _operation();
+    } catch (const std::exception &e) {
+      if (attempt == FETCH_ATTEMPTS)
+        throw;
+      BRIEF_SV(_logger, TRUNKS, e.what() << ", retrying.");
+    }
+  }
+}
+
+Repository parse(const fs::path &_description) {
+  std::ifstream src(_description.string());
+  const std::string buf((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  Tokenizer tokenizer(std::begin(buf).base(), std::end(buf).base());
+  Repository repo;
+  json<Repository>::parse(tokenizer, repo);
+  return repo;
+}
+
+}  // namespace
+
+constexpr const char *Trunks::INDEX;
+constexpr const char *Trunks::PACK;
+constexpr const char *Trunks::CHECKOUTS;
+constexpr const char *Trunks::OBJECTS;
+constexpr const char *Trunks::LOCK;
+
+/** Read-only mapping of a whole file, empty if the file is missing or empty. */
+struct Trunks::mapping_t {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+  mapping_t() = default;
+
+  explicit mapping_t(const fs::path &_path) {
+    const int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const char*>(data);
+        size_ = static_cast<size_t>(st.st_size);
+      }
+    }
+    close(fd);
+  }
+
+  ~mapping_t() {
+    if (data_)
+      munmap(const_cast<char*>(data_), size_);
+  }
+
+  mapping_t(const mapping_t&) = delete;
+  mapping_t& operator=(const mapping_t&) = delete;
+};
+
+Trunks::Trunks(Context &_ctx) : ctx_(_ctx) {
+  const char *root = std::getenv("BRIEF_TRUNKS");
+  const char *home = std::getenv("HOME");
+  if (root && *root)
+    root_ = root;
+  else if (home && *home)
+    root_ = fs::path(home) / ".brief" / "trunks";
+  else
+    root_ = fs::temp_directory_path() / "brief-trunks";
+}
+
+Trunks::~Trunks() {
+}
+
+void Trunks::setRoot(const fs::path &_root) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  root_ = _root;
+  opened_ = false;
+  index_.reset();
+  pack_.reset();
+}
+
+fs::path Trunks::root() const {
+  return root_;
+}
+
+bool Trunks::has(const Dependency &_dep) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  open();
+  return find(_dep.name_, _dep.tag_) != 0;
+}
+
+Task Trunks::retreive(const Dependency &_dep) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  open();
+  const uint64_t offset = find(_dep.name_, _dep.tag_);
+  if (offset == 0) {
+    throw std::runtime_error("Dependency " + _dep.name_ + (_dep.tag_.empty() ? "" : " at tag " + _dep.tag_)
+                             + " isn't installed.");
+  }
+
+  installed_t installed;
+  uint32_t size;
+  std::memcpy(&size, pack_->data_ + offset, sizeof(size));
+  MemoryBuffer buffer(pack_->data_ + header(offset, installed), pack_->data_ + offset + sizeof(size) + size);
+  std::istream src(&buffer);
+  Task task;
+  msgpack<Task>::read(src, task);
+  return task;
+}
+
+void Trunks::add(const Repository &_repo, const std::string &_tag, const fs::path &_description) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fs::create_directories(root_);
+  FileLock exclusive(root_ / LOCK, LOCK_EX, true);
+  map();
+
+  std::set<std::string> names;
+  for (const auto &exported : _repo.exports_)
+    names.insert(exported.first);
+
+  // Exports of the same name and tag are replaced
+  std::vector<slot_t> slots;
+  installed_t installed;
+  for (const slot_t &slot : this->slots()) {
+    header(slot.offset_, installed);
+    if (installed.tag_ != _tag || names.count(installed.export_) == 0)
+      slots.push_back(slot);
+  }
+
+  // A pack of another schema is dropped with its index
+  const fs::path packPath = root_ / PACK;
+  std::ofstream pack;
+  uint64_t offset;
+  if (pack_->data_) {
+    offset = fs::file_size(packPath);
+    pack.open(packPath.string(), std::ios::binary | std::ios::app);
+  } else {
+    pack.open(packPath.string(), std::ios::binary | std::ios::trunc);
+    const int32_t version = BRIEF_SCHEMA_VERSION;
+    pack.write(PACK_MAGIC, sizeof(PACK_MAGIC));
+    pack.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    offset = PACK_HEADER;
+  }
+  if (!pack)
+    throw std::runtime_error("Can't write trunks pack " + packPath.string());
+
+  for (const std::string &name : names) {
+    // Exports of a same name are told apart by filters, the first one is installed, as Repository::getTask does
+    std::set<std::string> visiting;
+    const Task task = inherit(_repo, _repo.exports_.find(name)->second, visiting);
+    std::ostringstream record;
+    writeString(record, name);
+    writeString(record, _tag);
+    writeString(record, _repo.name_);
+    writeString(record, _description.string());
+    msgpack<Task>::write(record, task);
+
+    const std::string data = record.str();
+    const auto size = static_cast<uint32_t>(data.size());
+    pack.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    pack.write(data.data(), data.size());
+    slots.push_back({hashKey(name, _tag), offset});
+    offset += sizeof(size) + data.size();
+  }
+  pack.close();
+  if (!pack)
+    throw std::runtime_error("Can't write trunks pack " + packPath.string());
+
+  rewrite(slots);
+  BRIEF_SV(ctx_.logger_, TRUNKS, "Installed " << names.size() << " exports of " << _repo.name_ << " at tag "
+           << (_tag.empty() ? "head" : _tag) << '.');
+}
+
+void Trunks::remove(const std::string &_repo, const std::string &_tag) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fs::create_directories(root_);
+  FileLock exclusive(root_ / LOCK, LOCK_EX, true);
+  map();
+  std::vector<slot_t> slots;
+  installed_t installed;
+  for (const slot_t &slot : this->slots()) {
+    header(slot.offset_, installed);
+    if (installed.repo_ != _repo || installed.tag_ != _tag)
+      slots.push_back(slot);
+  }
+  rewrite(slots);
+  BRIEF_SV(ctx_.logger_, TRUNKS, "Removed " << _repo << " at tag " << (_tag.empty() ? "head" : _tag) << '.');
+}
+
+std::vector<installed_t> Trunks::list() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  open();
+  std::vector<installed_t> result;
+  for (const slot_t &slot : slots()) {
+    result.emplace_back();
+    header(slot.offset_, result.back());
+  }
+  std::sort(result.begin(), result.end(), [](const installed_t &_a, const installed_t &_b) {
+    return std::tie(_a.export_, _a.tag_) < std::tie(_b.export_, _b.tag_);
+  });
+  return result;
+}
+
+void Trunks::fetch(const std::vector<Dependency> &_deps, size_t _jobs) {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::pair<std::string, std::string>> queue;
+  std::set<std::string> seen;
+  std::vector<std::string> failures;
+
+  // Tags of a same upstream are fetched one after the other in its object store
+  std::map<std::string, std::mutex> stores;
+
+  // Jobs queued or running, the workers are done once none is left
+  size_t pending = 0;
+  const auto fail = [&](const std::string &_url, const std::string &_failure) {
+    failures.push_back(_url + ": " + _failure);
+    ctx_.metrics_.counter("brief_fetch_failures_total", "Repositories that couldn't be fetched.").add();
+    BRIEF_SW(ctx_.logger_, TRUNKS, "Can't fetch " << _url << ": " << _failure);
+  };
+  const auto enqueue = [&](const Dependency &_dep) {
+    if (_dep.url_.empty() || !seen.insert(_dep.url_ + '@' + _dep.tag_).second)
+      return;
+    // Called from workers too, where an exception would terminate the process
+    try {
+      if (has(_dep))
+        return;
+    } catch (const std::exception &e) {
+      fail(_dep.url_, e.what());
+      return;
+    }
+    queue.emplace_back(_dep.url_, _dep.tag_);
+    pending++;
+  };
+  const auto report = [&failures]() {
+    if (!failures.empty()) {
+      throw std::runtime_error("Can't fetch " + std::to_string(failures.size()) + " dependencies, first one "
+                               + failures.front());
+    }
+  };
+  for (const Dependency &dep : _deps)
+    enqueue(dep);
+  if (queue.empty()) {
+    report();
+    return;
+  }
+
+  const auto work = [&](size_t _worker) {
+    ctx_.tracer_.nameThread("Fetch " + std::to_string(_worker));
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      changed.wait(lock, [&]() { return !queue.empty() || pending == 0; });
+      if (queue.empty())
+        return;
+      const auto job = queue.front();
+      queue.pop_front();
+      std::mutex &store = stores[job.first];
+      lock.unlock();
+
+      std::vector<Dependency> discovered;
+      std::string failure;
+      try {
+        discovered = install(job.first, job.second, store);
+      } catch (const std::exception &e) {
+        failure = e.what();
+      }
+
+      lock.lock();
+      if (!failure.empty())
+        fail(job.first, failure);
+      for (const Dependency &dep : discovered)
+        enqueue(dep);
+      pending--;
+      changed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < std::max<size_t>(1, _jobs); i++)
+    workers.emplace_back(work, i);
+  for (std::thread &worker : workers)
+    worker.join();
+  report();
+}
+
+std::vector<Dependency> Trunks::install(const std::string &_url, const std::string &_tag, std::mutex &_store) {
+  static const std::string HEAD = "refs/remotes/origin/HEAD";
+  static const std::vector<std::string> HISTORY = {
+    "+refs/heads/*:refs/remotes/origin/*",
+    "+refs/tags/*:refs/tags/*",
+    "+HEAD:" + HEAD
+  };
+
+  Tracer::Span span(ctx_.tracer_, "trunks", "Fetch " + _url);
+  const auto start = std::chrono::steady_clock::now();
+  const std::string name = upstreamName(_url);
+  const fs::path dir = root() / CHECKOUTS / name / (_tag.empty() ? "head" : _tag);
+
+  std::unique_lock<std::mutex> lock(_store);
+  GitRepository git(root() / OBJECTS / (name + ".git"), _url);
+  const auto fetch = [&](const std::vector<std::string> &_refspecs, int _depth) {
+    const uint64_t received = retry(ctx_.logger_, [&]() { return git.fetch(_refspecs, _depth); });
+    ctx_.metrics_.counter("brief_fetched_bytes_total", "Bytes received fetching dependencies.").add(received);
+  };
+
+  // Only the commit of a tag or branch is fetched, empty if the revision isn't one of them nor fetched yet
+  std::vector<std::string> references;
+  const auto fetchRevision = [&](const std::string &_rev) {
+    if (_rev.empty()) {
+      fetch({"+HEAD:" + HEAD}, 1);
+      return git.resolve(HEAD);
+    }
+    if (references.empty())
+      references = retry(ctx_.logger_, [&]() { return git.references(); });
+    const auto remote = [&](const std::string &_ref) {
+      return std::find(references.begin(), references.end(), _ref) != references.end();
+    };
+    const std::string tag = "refs/tags/" + _rev, branch = "refs/remotes/origin/" + _rev;
+    if (remote(tag)) {
+      // Tags don't move, one fetched by a previous run is kept
+      if (git.resolve(tag).empty())
+        fetch({"+" + tag + ":" + tag}, 1);
+      return git.resolve(tag);
+    }
+    if (remote("refs/heads/" + _rev)) {
+      fetch({"+refs/heads/" + _rev + ":" + branch}, 1);
+      return git.resolve(branch);
+    }
+    return git.resolve(_rev);
+  };
+
+  // Other tags are named by the description at the head, commits are found in the history
+  std::string id = fetchRevision(_tag);
+  if (id.empty()) {
+    git.checkout(fetchRevision(""), dir);
+    const std::string rev = revision(parse(findDescription(dir)), _tag);
+    id = fetchRevision(rev);
+    if (id.empty()) {
+      fetch(HISTORY, GitRepository::FULL);
+      id = git.resolve(rev);
+    }
+    if (id.empty())
+      throw std::runtime_error("Unknown tag " + _tag);
+  }
+  git.checkout(id, dir);
+  const fs::path description = findDescription(dir);
+  Repository repo = parse(description);
+
+  // Exports limited to a range of tags are kept if the commit is in it, which takes the history to tell
+  bool deepened = false;
+  for (auto exported = repo.exports_.begin(); exported != repo.exports_.end();) {
+    std::set<std::string> visiting;
+    const TaskFilters filters = inherit(repo, exported->second, visiting).filters_;
+    if (filters.minTag_.empty() && filters.maxTag_.empty()) {
+      ++exported;
+      continue;
+    }
+    if (!deepened) {
+      fetch(HISTORY, GitRepository::FULL);
+      deepened = true;
+    }
+    const auto bound = [&](const std::string &_bound) {
+      const std::string rev = revision(repo, _bound);
+      for (const std::string &candidate : {"refs/tags/" + rev, "refs/remotes/origin/" + rev, rev}) {
+        const std::string commit = git.resolve(candidate);
+        if (!commit.empty())
+          return commit;
+      }
+      throw std::runtime_error("Unknown tag " + _bound + " in the filters of " + exported->first);
+    };
+    if ((filters.minTag_.empty() || git.contains(id, bound(filters.minTag_)))
+        && (filters.maxTag_.empty() || git.contains(bound(filters.maxTag_), id)))
+      ++exported;
+    else
+      exported = repo.exports_.erase(exported);
+  }
+  lock.unlock();
+
+  add(repo, _tag, description);
+  ctx_.metrics_.histogram("brief_fetch_duration_microseconds", "Time to fetch and install a dependency.").record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+  // Dependencies satisfied by the repository itself aren't fetched
+  std::vector<Dependency> result;
+  for (const auto &exported : repo.exports_) {
+    std::set<std::string> visiting;
+    for (const Dependency &dep : inherit(repo, exported.second, visiting).dependencies_) {
+      if (repo.tasks_.count(dep.name_) == 0 && repo.exports_.count(dep.name_) == 0)
+        result.push_back(dep);
+    }
+  }
+  return result;
+}
+
+void Trunks::open() {
+  if (opened_)
+    return;
+  // Missing trunks are mapped as empty, without locking
+  FileLock shared(root_ / LOCK, LOCK_SH, false);
+  map();
+}
+
+void Trunks::map() {
+  opened_ = true;
+  index_.reset(new mapping_t(root_ / INDEX));
+  pack_.reset(new mapping_t(root_ / PACK));
+
+  // Trunks of another schema are ignored, as if empty
+  bool valid = pack_->size_ >= PACK_HEADER && std::equal(PACK_MAGIC, PACK_MAGIC + sizeof(PACK_MAGIC), pack_->data_);
+  if (valid) {
+    int32_t version;
+    std::memcpy(&version, pack_->data_ + sizeof(PACK_MAGIC), sizeof(version));
+    valid = version == BRIEF_SCHEMA_VERSION;
+  }
+  if (valid && index_->size_ >= sizeof(index_header_t)) {
+    const auto *index = reinterpret_cast<const index_header_t*>(index_->data_);
+    valid = std::equal(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC), index->magic_)
+        && index->version_ == BRIEF_SCHEMA_VERSION && index->capacity_ > 0
+        && (index->capacity_ & (index->capacity_ - 1)) == 0
+        && index_->size_ >= sizeof(index_header_t) + index->capacity_ * sizeof(slot_t)
+        && pack_->size_ >= index->packSize_;
+  } else {
+    valid = false;
+  }
+  if (!valid) {
+    index_.reset(new mapping_t());
+    pack_.reset(new mapping_t());
+  }
+}
+
+uint64_t Trunks::find(const std::string &_export, const std::string &_tag) const {
+  if (!index_->data_)
+    return 0;
+  const auto *index = reinterpret_cast<const index_header_t*>(index_->data_);
+  const auto *slots = reinterpret_cast<const slot_t*>(index_->data_ + sizeof(index_header_t));
+  const uint64_t mask = index->capacity_ - 1, hash = hashKey(_export, _tag);
+  installed_t installed;
+  for (uint64_t i = hash & mask, probes = 0; probes < index->capacity_; i = (i + 1) & mask, probes++) {
+    if (slots[i].offset_ == 0)
+      return 0;
+    if (slots[i].hash_ != hash)
+      continue;
+    header(slots[i].offset_, installed);
+    if (installed.export_ == _export && installed.tag_ == _tag)
+      return slots[i].offset_;
+  }
+  return 0;
+}
+
+uint64_t Trunks::header(uint64_t _offset, installed_t &_installed) const {
+  const auto corrupted = []() { return std::runtime_error("Corrupted trunks pack, remove its index to reset it."); };
+  uint32_t size;
+  if (_offset < PACK_HEADER || _offset + sizeof(size) > pack_->size_)
+    throw corrupted();
+  std::memcpy(&size, pack_->data_ + _offset, sizeof(size));
+  const uint64_t end = _offset + sizeof(size) + size;
+  if (end > pack_->size_)
+    throw corrupted();
+
+  uint64_t cur = _offset + sizeof(size);
+  std::string description;
+  for (std::string *field : {&_installed.export_, &_installed.tag_, &_installed.repo_, &description}) {
+    uint32_t length;
+    if (cur + sizeof(length) > end)
+      throw corrupted();
+    std::memcpy(&length, pack_->data_ + cur, sizeof(length));
+    cur += sizeof(length);
+    if (cur + length > end)
+      throw corrupted();
+    field->assign(pack_->data_ + cur, length);
+    cur += length;
+  }
+  _installed.description_ = description;
+  return cur;
+}
+
+void Trunks::rewrite(std::vector<slot_t> _slots) {
+  // Remapped, as records were appended since
+  pack_.reset(new mapping_t(root_ / PACK));
+  uint64_t live = PACK_HEADER;
+  for (const slot_t &slot : _slots) {
+    uint32_t size;
+    if (slot.offset_ + sizeof(size) > pack_->size_)
+      throw std::runtime_error("Corrupted trunks pack, remove its index to reset it.");
+    std::memcpy(&size, pack_->data_ + slot.offset_, sizeof(size));
+    live += sizeof(size) + size;
+  }
+  if (live < pack_->size_ / 2)
+    compact(_slots);
+
+  // At most half full, so that probe sequences stay short
+  uint32_t capacity = 16;
+  while (capacity < 2 * _slots.size())
+    capacity *= 2;
+  std::vector<slot_t> table(capacity, slot_t{0, 0});
+  for (const slot_t &slot : _slots) {
+    uint64_t i = slot.hash_ & (capacity - 1);
+    while (table[i].offset_ != 0)
+      i = (i + 1) & (capacity - 1);
+    table[i] = slot;
+  }
+
+  index_header_t index;
+  std::memcpy(index.magic_, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  index.version_ = BRIEF_SCHEMA_VERSION;
+  index.capacity_ = capacity;
+  index.count_ = _slots.size();
+  index.packSize_ = pack_->size_;
+
+  const fs::path path = root_ / INDEX, temporary = root_ / (std::string(INDEX) + ".tmp");
+  {
+    std::ofstream dst(temporary.string(), std::ios::binary | std::ios::trunc);
+    dst.write(reinterpret_cast<const char*>(&index), sizeof(index));
+    dst.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(slot_t));
+    dst.close();
+    if (!dst)
+      throw std::runtime_error("Can't write trunks index " + temporary.string());
+  }
+  fs::rename(temporary, path);
+  map();
+}
+
+void Trunks::compact(std::vector<slot_t> &_slots) {
+  // Records keep their order, offsets being remapped
+  std::sort(_slots.begin(), _slots.end(), [](const slot_t &_a, const slot_t &_b) { return _a.offset_ < _b.offset_; });
+  const fs::path path = root_ / PACK, temporary = root_ / (std::string(PACK) + ".tmp");
+  const size_t before = pack_->size_;
+  {
+    std::ofstream dst(temporary.string(), std::ios::binary | std::ios::trunc);
+    dst.write(pack_->data_, PACK_HEADER);
+    uint64_t offset = PACK_HEADER;
+    for (slot_t &slot : _slots) {
+      uint32_t size;
+      std::memcpy(&size, pack_->data_ + slot.offset_, sizeof(size));
+      dst.write(pack_->data_ + slot.offset_, sizeof(size) + size);
+      slot.offset_ = offset;
+      offset += sizeof(size) + size;
+    }
+    dst.close();
+    if (!dst)
+      throw std::runtime_error("Can't write trunks pack " + temporary.string());
+  }
+
+  // Readers are locked out until the index matching the new pack is renamed too, if interrupted meanwhile the old
+  // index is ignored as written for a larger pack
+  fs::rename(temporary, path);
+  pack_.reset(new mapping_t(path));
+  BRIEF_SV(ctx_.logger_, TRUNKS, "Compacted trunks pack from " << before << " to " << pack_->size_ << " bytes.");
+}
+
+std::vector<Trunks::slot_t> Trunks::slots() const {
+  std::vector<slot_t> result;
+  if (!index_->data_)
+    return result;
+  const auto *index = reinterpret_cast<const index_header_t*>(index_->data_);
+  const auto *slots = reinterpret_cast<const slot_t*>(index_->data_ + sizeof(index_header_t));
+  for (uint32_t i = 0; i < index->capacity_; i++) {
+    if (slots[i].offset_ != 0)
+      result.push_back(slots[i]);
+  }
+  return result;
 }
 
 }  // namespace brief
@@ -0,0 +1,111 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdio>
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/binlog.hpp"
+
+namespace fs = boost::filesystem;
+
+TEST(BinaryLog, Decode) {
+  const fs::path path = fs::temp_directory_path() / fs::unique_path("brief-binlog-%%%%-%%%%.bin");
+  {
+    brief::BinaryLog disabled;
+    BRIEF_BIN(disabled, "Ignored {}", 1);
+  }
+  {
+    brief::BinaryLog log;
+    log.open(path);
+    BRIEF_BIN(log, "Started");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([&log, t]() {
+        // Fills buffers several times
+        for (uint32_t i = 0; i < 10000; i++)
+          BRIEF_BIN(log, "Thread {} line {}", t, i);
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    BRIEF_BIN(log, "Mixed {} {} {} {}", std::string("string"), "literal", -1.5, uint64_t(1) << 63);
+    BRIEF_BIN(log, "Extra {}", 1, 2);
+    BRIEF_BIN(log, "Missing {} {}", 1);
+  }
+
+  std::ifstream src(path.string(), std::ios::binary);
+  std::stringstream text;
+  brief::BinaryLog::decode(src, text);
+  src.close();
+  fs::remove(path);
+
+  std::vector<uint32_t> next(4, 0);
+  size_t lines = 0;
+  std::string line;
+  while (std::getline(text, line)) {
+    int t;
+    uint32_t i;
+    if (std::sscanf(line.c_str(), "[%*u.%*u] #%*u Thread %d line %u", &t, &i) != 2)
+      continue;
+    ASSERT_LT(t, 4);
+    EXPECT_EQ(next[t], i);
+    next[t] = i + 1;
+    lines++;
+  }
+  EXPECT_EQ(40000u, lines);
+  const std::string decoded = text.str();
+  EXPECT_NE(std::string::npos, decoded.find("] #0 Started\n"));
+  EXPECT_NE(std::string::npos, decoded.find(" Mixed string literal -1.5 9223372036854775808\n"));
+  EXPECT_NE(std::string::npos, decoded.find(" Extra 1 2\n"));
+  EXPECT_NE(std::string::npos, decoded.find(" Missing 1 {}\n"));
+  EXPECT_EQ(std::string::npos, decoded.find("Ignored"));
+}
+
+TEST(BinaryLog, Invalid) {
+  std::stringstream text;
+  std::istringstream notLog("Not a binary log");
+  EXPECT_THROW(brief::BinaryLog::decode(notLog, text), std::runtime_error);
+
+  const fs::path path = fs::temp_directory_path() / fs::unique_path("brief-binlog-%%%%-%%%%.bin");
+  {
+    brief::BinaryLog log;
+    log.open(path);
+    BRIEF_BIN(log, "Complete {}", 1);
+    BRIEF_BIN(log, "Truncated {}", 2);
+  }
+  std::ifstream src(path.string(), std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  src.close();
+  fs::remove(path);
+
+  std::istringstream truncated(data.substr(0, data.size() - 4));
+  EXPECT_THROW(brief::BinaryLog::decode(truncated, text), std::runtime_error);
+  EXPECT_NE(std::string::npos, text.str().find(" Complete 1\n"));
+  EXPECT_EQ(std::string::npos, text.str().find("Truncated"));
+}
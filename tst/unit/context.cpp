@@ -16,7 +16,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -54,6 +62,222 @@ TEST(ContextTests, SimpleVars) {
   EXPECT_ANY_THROW(ctx.lookupVar(repo, task1, "unknown"));
 }
 
+TEST(ContextTests, Scope) {
+  brief::Context ctx;
+  ctx.registerVar("shadowed", "known");
+  int calls = 0;
+  ctx.registerVarPrefix("env", [&calls](const brief::Repository &, const brief::Task &, const std::string &var) {
+    calls++;
+    return "env:" + var;
+  });
+
+  brief::Repository repo;
+  repo.constants_.emplace("shadowed", "constant");
+  brief::Task task;
+  task.symbols_.emplace("shadowed", "symbol");
+
+  // Task symbols shadow repo constants, that shadow registered vars
+  EXPECT_EQ("symbol", brief::Scope(ctx, repo, task).lookup("shadowed"));
+  task.symbols_.clear();
+  EXPECT_EQ("constant", brief::Scope(ctx, repo, task).lookup("shadowed"));
+  repo.constants_.clear();
+  brief::Scope scope(ctx, repo, task);
+  EXPECT_EQ("known", scope.lookup("shadowed"));
+
+  // Prefix callbacks are only called once per variable
+  EXPECT_EQ("env:HOME", scope.lookup("env::HOME"));
+  EXPECT_EQ("env:HOME", scope.lookup("env::HOME"));
+  EXPECT_EQ("env:PATH", scope.lookup("env::PATH"));
+  EXPECT_EQ(2, calls);
+  EXPECT_ANY_THROW(scope.lookup("other::HOME"));
+}
+
+TEST(ContextTests, Preprocess) {
+  brief::Context ctx;
+  ctx.registerVar("root", "/src");
+  ctx.registerVarPrefix("env", [](const brief::Repository &, const brief::Task &, const std::string &var) {
+    return "$" + var;
+  });
+
+  brief::Repository repo;
+  repo.constants_.emplace("inc", "${root}/inc");
+  brief::Task task;
+  task.symbols_.emplace("gen", "${inc}/gen");
+  task.symbols_.emplace("loop1", "a${loop2}");
+  task.symbols_.emplace("loop2", "b${loop1}");
+
+  brief::Scope scope(ctx, repo, task);
+  EXPECT_EQ("plain", scope.expand("plain"));
+  EXPECT_EQ("$ and $x, ${", scope.expand("$$ and $x, $${"));
+  EXPECT_EQ("-I/src/inc -I/src/inc/gen $HOME", scope.expand("-I${inc} -I${gen} ${env::HOME}"));
+  EXPECT_ANY_THROW(scope.expand("${unknown}"));
+  EXPECT_ANY_THROW(scope.expand("${root"));
+  EXPECT_ANY_THROW(scope.expand("${}"));
+  try {
+    scope.expand("${loop1}");
+    FAIL();
+  } catch (const std::runtime_error &e) {
+    EXPECT_EQ(std::string("Variable references itself: loop1 -> loop2 -> loop1"), e.what());
+  }
+
+  // Only the expansions that used a registered variable see it changing
+  ctx.registerVar("unrelated", "value");
+  EXPECT_EQ("/src/inc/gen", scope.lookup("gen"));
+  ctx.registerVar("root", "/other");
+  EXPECT_EQ("/other/inc/gen", scope.lookup("gen"));
+  EXPECT_EQ("/other/inc", ctx.preprocessString(repo, task, "${inc}"));
+}
+
+namespace {
+
+class CountedToolchain : public brief::Toolchain {
+ public:
+  CountedToolchain(std::atomic<int> &_instances, bool _reentrant) : reentrant_(_reentrant) { _instances++; }
+
+  bool reentrant() const override { return reentrant_; }
+  plan_t plan(brief::Scheduler &_scheduler, const std::string &_name, const brief::Task &,
+              const std::vector<std::string> &, const std::vector<plan_t> &) override {
+    plan_t result;
+    result.interface_ = result.output_ = _scheduler.milestone(_name);
+    return result;
+  }
+  void test(const std::string &, const brief::Task &) override {}
+  void install(const std::string &, const brief::Task &) override {}
+
+ private:
+  bool reentrant_;
+};
+
+/** Not reentrant, its actions fail if they use an instance used by another worker. */
+class ExclusiveToolchain : public brief::Toolchain {
+ public:
+  ExclusiveToolchain(brief::Context &_ctx, std::atomic<int> &_alive) : ctx_(_ctx), alive_(_alive) { alive_++; }
+  ~ExclusiveToolchain() { alive_--; }
+
+  bool reentrant() const override { return false; }
+  plan_t plan(brief::Scheduler &_scheduler, const std::string &_name, const brief::Task &,
+              const std::vector<std::string> &, const std::vector<plan_t> &) override {
+    std::vector<brief::Scheduler::id_t> actions;
+    for (int i = 0; i < 64; i++) {
+      actions.push_back(_scheduler.add(_name + std::to_string(i), [this]() {
+        auto instance = std::static_pointer_cast<ExclusiveToolchain>(ctx_.getToolchain("exclusive"));
+        instance->use();
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_.insert(instance.get());
+      }));
+    }
+    plan_t result;
+    result.interface_ = result.output_ = _scheduler.milestone(_name, actions);
+    return result;
+  }
+  void test(const std::string &, const brief::Task &) override {}
+  void install(const std::string &, const brief::Task &) override {}
+
+  void use() {
+    if (busy_.exchange(true))
+      throw std::runtime_error("Instance used by two workers at once.");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    busy_ = false;
+  }
+
+  std::set<ExclusiveToolchain*> used_;
+
+ private:
+  brief::Context &ctx_;
+  std::atomic<int> &alive_;
+  std::atomic<bool> busy_ {false};
+  std::mutex mutex_;
+};
+
+}  // namespace
+
+TEST(ContextTests, Toolchains) {
+  brief::Context ctx;
+  std::atomic<int> shared {0}, perThread {0};
+  ctx.registerToolchain("shared", [&shared](brief::Context &) {
+    return std::make_shared<CountedToolchain>(shared, true);
+  });
+  ctx.registerToolchain("perThread", [&perThread](brief::Context &) {
+    return std::make_shared<CountedToolchain>(perThread, false);
+  });
+  EXPECT_ANY_THROW(ctx.getToolchain("unknown"));
+
+  // Reentrant toolchains are created once, others once per thread
+  const auto main = ctx.getToolchain("perThread");
+  EXPECT_EQ(main, ctx.getToolchain("perThread"));
+  std::shared_ptr<brief::Toolchain> first, other;
+  std::thread([&ctx, &first, &other]() {
+    first = ctx.getToolchain("shared");
+    other = ctx.getToolchain("perThread");
+  }).join();
+  EXPECT_EQ(first, ctx.getToolchain("shared"));
+  EXPECT_NE(main, other);
+  EXPECT_EQ(1, shared);
+  EXPECT_EQ(2, perThread);
+}
+
+TEST(ContextTests, ToolchainWorkers) {
+  std::atomic<int> alive {0};
+  {
+    brief::Context ctx;
+    ctx.registerToolchain("exclusive", [&alive](brief::Context &_ctx) {
+      return std::make_shared<ExclusiveToolchain>(_ctx, alive);
+    });
+    ctx.freeze();
+
+    // Actions planned on this thread use the instance of the worker running them
+    const auto planner = std::static_pointer_cast<ExclusiveToolchain>(ctx.getToolchain("exclusive"));
+    brief::Scheduler scheduler(ctx.logger_, 4);
+    planner->plan(scheduler, "task", brief::Task(), {}, {});
+    ASSERT_NO_THROW(scheduler.run());
+    EXPECT_LE(2u, planner->used_.size());
+    EXPECT_GE(4u, planner->used_.size());
+    EXPECT_EQ(0u, planner->used_.count(planner.get()));
+  }
+
+  // Instances don't outlive their context
+  EXPECT_EQ(0, alive);
+}
+
+TEST(ContextTests, Freeze) {
+  brief::Context ctx;
+  ctx.registerVar("version", "0");
+  ctx.registerVCSHandling("git://.*", [](brief::Context &, const std::string &) {
+    return std::shared_ptr<brief::VCS>();
+  });
+  ctx.freeze();
+  EXPECT_TRUE(ctx.frozen());
+
+  // Readers see either registries snapshot while registrations go on
+  brief::Repository repo;
+  brief::Task task;
+  std::atomic<bool> stop {false}, consistent {true};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&ctx, &repo, &task, &stop, &consistent]() {
+      brief::Scope scope(ctx, repo, task);
+      while (!stop) {
+        const int version = std::stoi(scope.expand("${version}"));
+        if (version < 0 || version > 100 || ctx.getVCS("git://example.com/repo.git") != nullptr)
+          consistent = false;
+      }
+    });
+  }
+  for (int i = 1; i <= 100; i++)
+    ctx.registerVar("version", std::to_string(i));
+  stop = true;
+  for (std::thread &reader : readers)
+    reader.join();
+  EXPECT_TRUE(consistent);
+
+  // Late registrations are visible
+  EXPECT_EQ("100", ctx.lookupVar(repo, task, "version"));
+  ctx.registerVCSHandling("svn://.*", [](brief::Context &, const std::string &) {
+    return std::shared_ptr<brief::VCS>();
+  });
+  EXPECT_NO_THROW(ctx.getVCS("svn://example.com/repo"));
+}
+
 TEST(ContextTests, Builder) {
   brief::Context ctx;
   ctx.builder_.buildCache(boost::filesystem::path("tst") / "helloworld" / "helloworld.json", {});
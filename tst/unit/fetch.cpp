@@ -0,0 +1,172 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/context.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+brief::Dependency dependency(const std::string &_name, const std::string &_tag, const std::string &_url) {
+  brief::Dependency dep;
+  dep.name_ = _name;
+  dep.tag_ = _tag;
+  dep.url_ = _url;
+  return dep;
+}
+
+void git(const fs::path &_dir, const std::string &_args) {
+  const std::string command = "git -C " + _dir.string() + " -c user.name=brief -c user.email=brief@localhost "
+      + _args + " >/dev/null 2>&1";
+  if (std::system(command.c_str()) != 0)
+    throw std::runtime_error("Failed: " + command);
+}
+
+/** Commits a description in a work repository, tagged if *_tag* isn't empty. */
+void commit(const fs::path &_work, const std::string &_description, const std::string &_tag) {
+  if (!fs::exists(_work)) {
+    fs::create_directories(_work);
+    git(_work, "init -q");
+  }
+  std::ofstream(((_work / _work.filename()).string() + ".brief")) << _description;
+  git(_work, "add -A");
+  git(_work, "commit -q -m update");
+  if (!_tag.empty())
+    git(_work, "tag " + _tag);
+}
+
+/** Bare copy of a work repository, as a file:// url. */
+std::string publish(const fs::path &_work, const fs::path &_remotes) {
+  const fs::path bare = _remotes / (_work.filename().string() + ".git");
+  fs::remove_all(bare);
+  git(_work, "clone -q --bare . " + bare.string());
+  return "file://" + bare.string();
+}
+
+/** Object store of an upstream in the trunks. */
+fs::path store(const fs::path &_trunks, const std::string &_name) {
+  for (auto entry : fs::directory_iterator(_trunks / brief::Trunks::OBJECTS)) {
+    if (entry.path().filename().string().compare(0, _name.size() + 1, _name + "-") == 0)
+      return entry.path();
+  }
+  throw std::runtime_error("No object store for " + _name);
+}
+
+}  // namespace
+
+TEST(Trunks, Fetch) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-fetch-%%%%-%%%%");
+  const fs::path work = root / "work", remotes = root / "remotes";
+
+  commit(work / "zlib", R"({"name": "zlib", "exports": {"zlib": {"sources": ["zlib.c"]}}})", "");
+  const std::string zlib = publish(work / "zlib", remotes);
+
+  // The stable tag of jpeg is named by its description only
+  commit(work / "jpeg", R"({"name": "jpeg", "exports": {"jpeg": {"sources": ["old.c"]}}})", "r1");
+  commit(work / "jpeg", R"({"name": "jpeg", "exports": {"jpeg": {"sources": ["new.c"]},
+                            "turbo": {"filters": {"minTag": "r2"}}, "legacy": {"filters": {"maxTag": "r1"}}}})", "r2");
+  commit(work / "jpeg", R"({"name": "jpeg", "tags": {"stable": {"tag": "r1"}},
+                            "exports": {"jpeg": {"sources": ["head.c"]}}})", "");
+  const std::string jpeg = publish(work / "jpeg", remotes);
+
+  commit(work / "png", R"({"name": "png", "exports": {"png": {"sources": ["png.c"], "dependencies": [
+                            {"name": "zlib", "url": ")" + zlib + R"("},
+                            {"name": "jpeg", "tag": "stable", "url": ")" + jpeg + R"("}]}}})", "v1");
+  commit(work / "png", R"({"name": "png", "exports": {"png": {"sources": ["png2.c"]}}})", "");
+  const std::string png = publish(work / "png", remotes);
+
+  brief::Context ctx(brief::Logger::W);
+  ctx.trunks_.setRoot(root / "trunks");
+  ctx.trunks_.fetch({dependency("png", "v1", png), dependency("zlib", "", zlib)}, 2);
+  EXPECT_EQ(std::vector<std::string> {"png.c"}, ctx.trunks_.retreive(dependency("png", "v1", png)).sources_);
+  EXPECT_EQ(std::vector<std::string> {"zlib.c"}, ctx.trunks_.retreive(dependency("zlib", "", zlib)).sources_);
+  EXPECT_EQ(std::vector<std::string> {"old.c"}, ctx.trunks_.retreive(dependency("jpeg", "stable", jpeg)).sources_);
+  EXPECT_FALSE(ctx.trunks_.has(dependency("png", "", png)));
+  EXPECT_EQ(3u, ctx.trunks_.list().size());
+
+  // Upstreams are fetched shallowly in a store shared by their checkouts
+  const fs::path trunks = root / "trunks";
+  EXPECT_TRUE(fs::exists(store(trunks, "png") / "shallow"));
+  EXPECT_TRUE(fs::exists(store(trunks, "jpeg") / "shallow"));
+  EXPECT_TRUE(fs::exists(trunks / brief::Trunks::CHECKOUTS / store(trunks, "jpeg").stem() / "stable" / "jpeg.brief"));
+
+  // Comparing tags deepens the history
+  ctx.trunks_.fetch({dependency("jpeg", "r2", jpeg)});
+  EXPECT_EQ(std::vector<std::string> {"new.c"}, ctx.trunks_.retreive(dependency("jpeg", "r2", jpeg)).sources_);
+  EXPECT_TRUE(ctx.trunks_.has(dependency("turbo", "r2", jpeg)));
+  EXPECT_FALSE(ctx.trunks_.has(dependency("legacy", "r2", jpeg)));
+  EXPECT_FALSE(fs::exists(store(trunks, "jpeg") / "shallow"));
+  EXPECT_EQ(3, std::distance(fs::directory_iterator(trunks / brief::Trunks::OBJECTS), fs::directory_iterator()));
+  EXPECT_EQ(5u, ctx.trunks_.list().size());
+
+  // Installed dependencies aren't fetched again, failures are reported once the others are installed
+  fs::remove_all(remotes / "zlib.git");
+  EXPECT_THROW(ctx.trunks_.fetch({dependency("zlib", "", zlib), dependency("png", "", png),
+                                  dependency("gif", "", "file://" + (remotes / "gif.git").string())}),
+               std::runtime_error);
+  EXPECT_EQ(std::vector<std::string> {"png2.c"}, ctx.trunks_.retreive(dependency("png", "", png)).sources_);
+  EXPECT_FALSE(ctx.trunks_.has(dependency("gif", "", "")));
+  EXPECT_EQ(6u, ctx.trunks_.list().size());
+  ctx.trunks_.fetch({dependency("zlib", "", zlib), dependency("jpeg", "stable", jpeg)});
+  fs::remove_all(root);
+}
+
+TEST(Trunks, FetchCorrupted) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-fetch-%%%%-%%%%");
+  commit(root / "work" / "zlib", R"({"name": "zlib", "exports": {"zlib": {"sources": ["zlib.c"]}}})", "");
+  const std::string zlib = publish(root / "work" / "zlib", root / "remotes");
+  {
+    brief::Context ctx(brief::Logger::W);
+    ctx.trunks_.setRoot(root / "trunks");
+    ctx.trunks_.fetch({dependency("zlib", "", zlib)});
+  }
+
+  // Make the size of the record of zlib overflow the pack
+  const fs::path pack = root / "trunks" / brief::Trunks::PACK;
+  std::string content;
+  {
+    std::ifstream src(pack.string(), std::ios::binary);
+    content.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  }
+  const size_t name = content.find(std::string("\x04\0\0\0zlib", 8));
+  ASSERT_NE(std::string::npos, name);
+  content.replace(name - 4, 4, "\xff\xff\xff\x7f");
+  std::ofstream(pack.string(), std::ios::binary | std::ios::trunc) << content;
+
+  // Checking whether it is installed fails like a fetch
+  brief::Context ctx(brief::Logger::W);
+  ctx.trunks_.setRoot(root / "trunks");
+  try {
+    ctx.trunks_.fetch({dependency("zlib", "", zlib)});
+    ADD_FAILURE() << "Corrupted trunks not reported";
+  } catch (const std::runtime_error &e) {
+    EXPECT_EQ(0, std::string(e.what()).find("Can't fetch 1 dependencies"));
+  }
+  fs::remove_all(root);
+}
@@ -0,0 +1,48 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/context.hpp"
+#include "generator.hpp"
+
+namespace fs = boost::filesystem;
+
+TEST(Generator, Build) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-generated-%%%%-%%%%");
+  brief::generator_options_t options;
+  options.tasks_ = 6;
+  options.sources_ = 2;
+  const brief::Repository repo = brief::generate(options);
+  brief::writeSources(repo, options, root);
+  const fs::path description = root / "synthetic.brief";
+  {
+    std::ofstream dst(description.string());
+    brief::json<brief::Repository>::serialize(dst, repo);
+  }
+
+  // Tasks use constants of the description, expanded once merged with their flavors
+  brief::Context ctx(brief::Logger::W);
+  ctx.builder_.buildCache(description, {});
+  ctx.builder_.build(repo.all_, {"debug"}, brief::build_options_t());
+  EXPECT_TRUE(fs::exists(root / brief::Builder::OUTPUT_DIR));
+  fs::remove_all(root);
+}
@@ -0,0 +1,56 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/glob.hpp"
+
+namespace fs = boost::filesystem;
+
+TEST(Glob, Patterns) {
+  const fs::path root = fs::path("tst");
+
+  EXPECT_EQ(std::vector<fs::path>({"library/hello.cpp", "library/library.cpp"}), brief::glob(root, "library/*.cpp"));
+  EXPECT_EQ(std::vector<fs::path>({"library/library.h"}), brief::glob(root, "*/*.h"));
+  EXPECT_EQ(std::vector<fs::path>({"helloworld/hello.cpp", "library/hello.cpp"}), brief::glob(root, "**/hello.cpp"));
+  EXPECT_EQ(std::vector<fs::path>({"missing.cpp"}), brief::glob(root, "missing.cpp"));
+  EXPECT_TRUE(brief::glob(root, "missing/*.cpp").empty());
+}
+
+TEST(Glob, Skipped) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-glob-%%%%-%%%%");
+  for (const char *dir : {"src/build", ".git", "build", "other"})
+    fs::create_directories(root / dir);
+  for (const char *file : {"main.cpp", "src/a.cpp", "src/build/b.cpp", "src/.c.cpp", ".git/d.cpp", "build/batch.cpp",
+                           "other/e.cpp"})
+    std::ofstream((root / file).string());
+  fs::create_directory_symlink(root / "other", root / "src/link");
+  fs::create_directory_symlink(root, root / "src/loop");
+
+  // Hidden entries, the output directory and symlinks aren't searched, a build directory elsewhere is
+  EXPECT_EQ(std::vector<fs::path>({"main.cpp", "other/e.cpp", "src/a.cpp", "src/build/b.cpp"}),
+            brief::glob(root, "**/*.cpp"));
+  EXPECT_EQ(std::vector<fs::path>({"src/a.cpp"}), brief::glob(root, "src/*.cpp"));
+  EXPECT_EQ(std::vector<fs::path>({"build/batch.cpp"}), brief::glob(root, "build/*.cpp"));
+  fs::remove_all(root);
+}
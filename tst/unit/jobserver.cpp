@@ -0,0 +1,106 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "brief/jobserver.hpp"
+#include "brief/logger.hpp"
+#include "brief/scheduler.hpp"
+
+TEST(Jobserver, Fifo) {
+  auto server = brief::Jobserver::create(3);
+  ASSERT_NE(nullptr, server);
+  EXPECT_EQ(0u, server->makeflags().find("-j3 --jobserver-auth=fifo:"));
+
+  // Two tokens beside the implicit job, shared with the clients
+  auto client = brief::Jobserver::join("-k " + server->makeflags());
+  ASSERT_NE(nullptr, client);
+  EXPECT_TRUE(client->tryAcquire());
+  EXPECT_TRUE(server->tryAcquire());
+  EXPECT_FALSE(client->tryAcquire());
+  client->release();
+  EXPECT_TRUE(server->acquire());
+  server->release();
+  server->release();
+
+  // An interrupted acquire gives up
+  EXPECT_TRUE(server->acquire());
+  EXPECT_TRUE(server->acquire());
+  server->interrupt();
+  EXPECT_FALSE(server->acquire());
+}
+
+TEST(Jobserver, Pipe) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(2, write(fds[1], "ab", 2));
+
+  const std::string auth = std::to_string(fds[0]) + "," + std::to_string(fds[1]);
+  auto client = brief::Jobserver::join("-j3 --jobserver-fds=0,0 --jobserver-auth=" + auth);
+  ASSERT_NE(nullptr, client);
+  EXPECT_TRUE(client->tryAcquire());
+  EXPECT_TRUE(client->tryAcquire());
+  EXPECT_FALSE(client->tryAcquire());
+  client.reset();
+
+  // Tokens are given back as they were read
+  char tokens[3] = {};
+  EXPECT_EQ(2, read(fds[0], tokens, 2));
+  std::sort(tokens, tokens + 2);
+  EXPECT_EQ("ab", std::string(tokens));
+  close(fds[0]);
+  close(fds[1]);
+
+  EXPECT_EQ(nullptr, brief::Jobserver::join("-j --jobserver-auth=-2,-2"));
+  EXPECT_EQ(nullptr, brief::Jobserver::join("-j4"));
+}
+
+TEST(Jobserver, Scheduler) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  auto jobserver = brief::Jobserver::create(2);
+  brief::Scheduler scheduler(logger, 8);
+  scheduler.setJobserver(jobserver.get());
+
+  // The jobserver limits parallelism below the jobs of the scheduler
+  std::atomic<int> running {0}, peak {0};
+  for (int i = 0; i < 8; i++) {
+    scheduler.add("sleep", [&running, &peak]() {
+      const int current = ++running;
+      for (int seen = peak; current > seen && !peak.compare_exchange_weak(seen, current);) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      running--;
+    });
+  }
+  scheduler.run();
+  EXPECT_LE(peak, 2);
+  EXPECT_EQ(2, peak);
+
+  // All tokens were given back
+  EXPECT_TRUE(jobserver->tryAcquire());
+  EXPECT_FALSE(jobserver->tryAcquire());
+}
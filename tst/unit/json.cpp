@@ -52,11 +52,13 @@ TEST(JsonReader, Tokenizer) {
 }
 
 TEST(JsonReader, Parser) {
-  const std::string test = "42 3.14 \"\" \"test\" [1, 2, 4] {\"a\": 1, \"b\": 2}";
+  const std::string test = "42 3.14 true false \"\" \"test\" [1, 2, 4] {\"a\": 1, \"b\": 2}";
   brief::Tokenizer tok1(test.data(), test.data() + test.size());
 
   ASSERT_EQ(42, brief::parse<int>(tok1));
   ASSERT_FLOAT_EQ(3.14, brief::parse<float>(tok1));
+  ASSERT_TRUE(brief::parse<bool>(tok1));
+  ASSERT_FALSE(brief::parse<bool>(tok1));
   ASSERT_EQ("", brief::parse<std::string>(tok1));
   ASSERT_EQ("test", brief::parse<std::string>(tok1));
 
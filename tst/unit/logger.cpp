@@ -0,0 +1,174 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "brief/logger.hpp"
+
+namespace {
+
+/** Target readable while the writer thread writes to it, waking readers on each flush. */
+class SharedBuffer : public std::streambuf {
+ public:
+  /** Waits up to *_timeout* for *_text* to be flushed. */
+  bool waitFor(const std::string &_text, std::chrono::milliseconds _timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return flushed_.wait_for(lock, _timeout, [this, &_text]() { return content_.find(_text) != std::string::npos; });
+  }
+
+  std::string content() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return content_;
+  }
+
+ protected:
+  std::streamsize xsputn(const char *_data, std::streamsize _size) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    content_.append(_data, static_cast<size_t>(_size));
+    return _size;
+  }
+
+  int_type overflow(int_type _c) override {
+    if (!traits_type::eq_int_type(_c, traits_type::eof())) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      content_.push_back(traits_type::to_char_type(_c));
+    }
+    return traits_type::not_eof(_c);
+  }
+
+  int sync() override {
+    flushed_.notify_all();
+    return 0;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable flushed_;
+  std::string content_;
+};
+
+}  // namespace
+
+TEST(Logger, Warnings) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::I);
+  BRIEF_I(logger, "Queued");
+  BRIEF_V(logger, "Filtered");
+  BRIEF_W(logger, "Flushed " << 42);
+  const std::string written = log.str();
+  EXPECT_NE(std::string::npos, written.find("] INFO Queued\n"));
+  EXPECT_NE(std::string::npos, written.find("] WARN Flushed 42\n"));
+  EXPECT_LT(written.find("Queued"), written.find("Flushed"));
+  EXPECT_EQ(std::string::npos, written.find("Filtered"));
+}
+
+TEST(Logger, Threads) {
+  const size_t threads = 8, lines = 1000;
+  std::stringstream log;
+  {
+    brief::Logger logger(log, brief::Logger::V);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+      pool.emplace_back([&logger, t]() {
+        for (size_t i = 0; i < lines; ++i)
+          BRIEF_V(logger, "thread " << t << " line " << i);
+      });
+    }
+    for (auto &thread : pool)
+      thread.join();
+  }
+
+  // Every line is whole, in the order of its thread, and timestamps never go back
+  std::vector<size_t> next(threads, 0);
+  long long last = 0;
+  std::string line;
+  while (std::getline(log, line)) {
+    size_t t, i;
+    long long ms;
+    char verbose[5];
+    if (std::sscanf(line.c_str(), "[%lld] %4s thread %zu line %zu", &ms, verbose, &t, &i) != 4)
+      continue;
+    ASSERT_LT(t, threads);
+    EXPECT_EQ(next[t], i);
+    next[t] = i + 1;
+    EXPECT_LE(last, ms);
+    last = ms;
+  }
+  for (size_t t = 0; t < threads; ++t)
+    EXPECT_EQ(lines, next[t]);
+}
+
+TEST(Logger, Levels) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::I);
+  logger.configure("warn,scheduler=debug,cache=verbose");
+  EXPECT_TRUE(logger.enabled(brief::Logger::W));
+  EXPECT_FALSE(logger.enabled(brief::Logger::I));
+  EXPECT_FALSE(logger.enabled(brief::Logger::I, brief::Logger::PARSER));
+  EXPECT_TRUE(logger.enabled(brief::Logger::D, brief::Logger::SCHEDULER));
+  EXPECT_EQ(brief::Logger::V, logger.level(brief::Logger::CACHE));
+  EXPECT_THROW(logger.configure("loud"), std::runtime_error);
+  EXPECT_THROW(logger.configure("linker=debug"), std::runtime_error);
+
+  // Filtered lines don't evaluate their arguments
+  size_t evaluated = 0;
+  const auto count = [&evaluated]() { return ++evaluated; };
+  BRIEF_I(logger, "Filtered " << count());
+  BRIEF_SV(logger, PARSER, "Filtered " << count());
+  BRIEF_SV(logger, SCHEDULER, "Evaluated " << count());
+  EXPECT_EQ(1u, evaluated);
+
+  logger.setLevel(brief::Logger::SCHEDULER, brief::Logger::W);
+  BRIEF_SV(logger, SCHEDULER, "Filtered " << count());
+  BRIEF_SW(logger, VCS, "Flushed");
+  EXPECT_EQ(1u, evaluated);
+  const std::string written = log.str();
+  EXPECT_NE(std::string::npos, written.find("] VERB scheduler: Evaluated 1\n"));
+  EXPECT_NE(std::string::npos, written.find("] WARN vcs: Flushed\n"));
+  EXPECT_EQ(std::string::npos, written.find("Filtered"));
+}
+
+TEST(Logger, Wakeup) {
+  SharedBuffer buffer;
+  std::ostream target(&buffer);
+  brief::Logger logger(target, brief::Logger::V);
+
+  // Lines are written without flushing, the writer being woken by their commit
+  ASSERT_TRUE(buffer.waitFor("] VERB Log start: ", std::chrono::seconds(10)));
+  BRIEF_I(logger, "First");
+  ASSERT_TRUE(buffer.waitFor("] INFO First\n", std::chrono::seconds(10)));
+  BRIEF_I(logger, "Second");
+  BRIEF_I(logger, "Third");
+  ASSERT_TRUE(buffer.waitFor("] INFO Third\n", std::chrono::seconds(10)));
+
+  // The date of the first line doesn't end with an empty one
+  const std::string written = buffer.content();
+  EXPECT_EQ(std::string::npos, written.find("\n\n"));
+  EXPECT_LT(written.find("Second"), written.find("Third"));
+}
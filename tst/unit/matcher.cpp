@@ -0,0 +1,93 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "brief/matcher.hpp"
+
+TEST(UriMatcher, Prefix) {
+  bool literal;
+  EXPECT_EQ("git://", brief::UriMatcher::prefix("git://.*", literal));
+  EXPECT_FALSE(literal);
+  EXPECT_EQ("http", brief::UriMatcher::prefix("^https?://.*", literal));
+  EXPECT_EQ("https://github.com/", brief::UriMatcher::prefix("https://github\\.com/[^/]+/[^/]+", literal));
+  EXPECT_EQ("svn", brief::UriMatcher::prefix("svn+ssh://.*", literal));
+  EXPECT_EQ("", brief::UriMatcher::prefix("git://.*|.*\\.git", literal));
+  EXPECT_EQ("file://", brief::UriMatcher::prefix("file://\\w+", literal));
+  EXPECT_EQ("repo.example", brief::UriMatcher::prefix("repo\\.example", literal));
+  EXPECT_TRUE(literal);
+}
+
+TEST(UriMatcher, Match) {
+  brief::UriMatcher matcher;
+  EXPECT_EQ(brief::UriMatcher::NONE, matcher.match("git://example.com/repo.git"));
+
+  EXPECT_EQ(0u, matcher.add("https://github\\.com/.*"));
+  EXPECT_EQ(1u, matcher.add("git://.*"));
+  EXPECT_EQ(2u, matcher.add(std::regex(".*\\.git")));
+  EXPECT_EQ(3u, matcher.add("https?://.*"));
+  EXPECT_EQ(4u, matcher.add("file:///srv/repo"));
+
+  // The first pattern added wins, whatever its prefix
+  EXPECT_EQ(0u, matcher.match("https://github.com/Jiboo/brief.git"));
+  EXPECT_EQ(1u, matcher.match("git://example.com/repo.git"));
+  EXPECT_EQ(2u, matcher.match("https://example.com/repo.git"));
+  EXPECT_EQ(3u, matcher.match("http://example.com/repo"));
+  EXPECT_EQ(3u, matcher.match("http://example.com/repo"));
+  EXPECT_EQ(4u, matcher.match("file:///srv/repo"));
+  EXPECT_EQ(brief::UriMatcher::NONE, matcher.match("file:///srv/repo2"));
+  EXPECT_EQ(brief::UriMatcher::NONE, matcher.match("ftp://example.com/repo"));
+
+  // Memoized results are dropped when patterns are added
+  EXPECT_EQ(5u, matcher.add("ftp://.*"));
+  EXPECT_EQ(5u, matcher.match("ftp://example.com/repo"));
+}
+
+TEST(UriMatcher, Memo) {
+  brief::UriMatcher matcher;
+  matcher.add("git://.*");
+
+  // Copies match the same, and forget their results independently
+  brief::UriMatcher copy = matcher;
+  EXPECT_EQ(0u, matcher.match("git://example.com/repo.git"));
+  EXPECT_EQ(0u, copy.match("git://example.com/repo.git"));
+  copy.add("https://.*");
+  EXPECT_EQ(1u, copy.match("https://example.com/repo.git"));
+  EXPECT_EQ(brief::UriMatcher::NONE, matcher.match("https://example.com/repo.git"));
+
+  // Results stay right past the capacity of the memo, with threads matching at once
+  std::vector<std::thread> threads;
+  std::vector<int> failures(4, 0);
+  for (size_t t = 0; t < failures.size(); t++) {
+    threads.emplace_back([&matcher, &failures, t]() {
+      for (size_t i = 0; i < 2 * brief::UriMatcher::SHARDS * brief::UriMatcher::CAPACITY; i++) {
+        const std::string id = std::to_string(i % 5000);
+        failures[t] += matcher.match("git://example.com/" + id) != 0;
+        failures[t] += matcher.match("svn://example.com/" + id) != brief::UriMatcher::NONE;
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  EXPECT_EQ(std::vector<int>(failures.size(), 0), failures);
+}
@@ -0,0 +1,112 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "brief/logger.hpp"
+#include "brief/metrics.hpp"
+#include "brief/scheduler.hpp"
+
+TEST(Metrics, Buckets) {
+  using Histogram = brief::Metrics::Histogram;
+  for (uint64_t value = 0; value < 32; value++)
+    EXPECT_EQ(value, Histogram::lowest(Histogram::bucket(value)));
+  for (size_t bucket = 0; bucket < Histogram::BUCKETS; bucket++) {
+    EXPECT_EQ(bucket, Histogram::bucket(Histogram::lowest(bucket)));
+    EXPECT_EQ(bucket, Histogram::bucket(Histogram::highest(bucket)));
+  }
+  EXPECT_EQ(Histogram::BUCKETS - 1, Histogram::bucket(UINT64_MAX));
+
+  // Within 1/16 of the recorded values
+  for (uint64_t value : {33ull, 1000ull, 123456789ull}) {
+    const size_t bucket = Histogram::bucket(value);
+    EXPECT_LE(Histogram::lowest(bucket), value);
+    EXPECT_GE(Histogram::highest(bucket), value);
+    EXPECT_LE(Histogram::highest(bucket) - Histogram::lowest(bucket), value / 16);
+  }
+}
+
+TEST(Metrics, Record) {
+  brief::Metrics metrics;
+  brief::Metrics::Counter &counter = metrics.counter("test_events_total", "Events.");
+  brief::Metrics::Histogram &histogram = metrics.histogram("test_duration_microseconds", "Durations.");
+  EXPECT_EQ(&counter, &metrics.counter("test_events_total", "Same."));
+  EXPECT_THROW(metrics.gauge("test_events_total", "Taken."), std::runtime_error);
+  EXPECT_THROW(metrics.counter("0test", "Invalid."), std::runtime_error);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&counter, &histogram]() {
+      for (uint64_t i = 1; i <= 1000; i++) {
+        counter.add();
+        histogram.record(i);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  metrics.gauge("test_depth", "Depth.").set(-3);
+
+  EXPECT_EQ(4000u, counter.value());
+  const brief::Metrics::Histogram::snapshot_t snapshot = histogram.snapshot();
+  EXPECT_EQ(4000u, snapshot.count_);
+  EXPECT_EQ(4u * 500500, snapshot.sum_);
+  EXPECT_EQ(1u, snapshot.min_);
+  EXPECT_EQ(1000u, snapshot.max_);
+  EXPECT_NEAR(500, snapshot.percentile(0.5), 500 / 16);
+  EXPECT_NEAR(990, snapshot.percentile(0.99), 990 / 16);
+  EXPECT_EQ(1000u, snapshot.percentile(1));
+
+  std::stringstream json, prometheus;
+  metrics.writeJson(json);
+  metrics.writePrometheus(prometheus);
+  EXPECT_NE(std::string::npos, json.str().find("\"test_events_total\":4000"));
+  EXPECT_NE(std::string::npos, json.str().find("\"test_depth\":-3"));
+  EXPECT_NE(std::string::npos, json.str().find("\"test_duration_microseconds\":{\"count\":4000,\"sum\":2002000,"
+                                               "\"min\":1,\"max\":1000,"));
+  EXPECT_NE(std::string::npos, prometheus.str().find("# TYPE test_events_total counter\ntest_events_total 4000\n"));
+  EXPECT_NE(std::string::npos, prometheus.str().find("# TYPE test_depth gauge\ntest_depth -3\n"));
+  EXPECT_NE(std::string::npos, prometheus.str().find("test_duration_microseconds{quantile=\"0.99\"} "));
+  EXPECT_NE(std::string::npos, prometheus.str().find("test_duration_microseconds_count 4000\n"));
+}
+
+TEST(Metrics, Scheduler) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::Metrics metrics;
+  brief::Scheduler scheduler(logger, 2);
+  scheduler.setMetrics(metrics);
+  const auto first = scheduler.add("First", []() {});
+  scheduler.add("Second", []() { brief::Scheduler::report({0, true}); }, {first});
+  scheduler.add("Third", []() {}, {first});
+  scheduler.run();
+
+  EXPECT_EQ(1u, metrics.counter("brief_action_cache_hits_total", "").value());
+  EXPECT_EQ(2u, metrics.counter("brief_action_cache_misses_total", "").value());
+  EXPECT_EQ(3u, metrics.histogram("brief_action_duration_microseconds", "").snapshot().count_);
+  EXPECT_EQ(0, metrics.gauge("brief_scheduler_running_actions", "").value());
+  EXPECT_EQ(0, metrics.gauge("brief_scheduler_ready_actions", "").value());
+}
@@ -0,0 +1,68 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/process.hpp"
+
+TEST(Spawner, Run) {
+  brief::Spawner spawner;
+  spawner.setEnv("BRIEF_TEST_VAR", "value");
+
+  brief::process_result_t result = spawner.run({"sh", "-c", "echo out; echo err >&2; echo $BRIEF_TEST_VAR; exit 3"});
+  EXPECT_EQ(3, result.status_);
+  EXPECT_EQ("out\nerr\nvalue\n", result.output_);
+  EXPECT_LT(0u, result.peakMemory_);
+
+  EXPECT_EQ(128 + 9, spawner.run({"sh", "-c", "kill -9 $$"}).status_);
+  EXPECT_ANY_THROW(spawner.run({"/nonexistent/brief/binary"}));
+}
+
+TEST(Spawner, Concurrent) {
+  const int COUNT = 200;
+  brief::Spawner spawner;
+  std::atomic<int> succeeded {0};
+  for (int i = 0; i < COUNT; i++) {
+    spawner.spawn({"sh", "-c", "sleep 0.1; exit " + std::to_string(i % 2)}, [&succeeded](const auto &_result) {
+      if (_result.status_ == 0)
+        succeeded++;
+    });
+  }
+  spawner.wait();
+  EXPECT_EQ(COUNT / 2, succeeded);
+  EXPECT_EQ(0u, spawner.running());
+}
+
+TEST(Spawner, ResponseFile) {
+  brief::Spawner spawner(64);
+  std::vector<std::string> args {"echo"};
+  for (int i = 0; i < 32; i++)
+    args.push_back("argument");
+
+  brief::process_result_t result = spawner.run(args);
+  ASSERT_EQ('@', result.output_[0]);
+  EXPECT_FALSE(boost::filesystem::exists(result.output_.substr(1, result.output_.size() - 2)));
+
+  result = spawner.run(args, false);
+  EXPECT_EQ('a', result.output_[0]);
+}
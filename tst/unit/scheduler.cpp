@@ -0,0 +1,182 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "brief/logger.hpp"
+#include "brief/scheduler.hpp"
+#include "brief/state.hpp"
+
+TEST(Scheduler, Order) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::Scheduler scheduler(logger, 4);
+
+  std::mutex mutex;
+  std::vector<std::string> done;
+  auto record = [&mutex, &done](const std::string &_name) {
+    return [&mutex, &done, _name]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      done.push_back(_name);
+    };
+  };
+  auto index = [&done](const std::string &_name) {
+    return std::find(done.begin(), done.end(), _name) - done.begin();
+  };
+
+  const auto a = scheduler.add("a", record("a"));
+  const auto b = scheduler.add("b", record("b"), {a});
+  const auto c = scheduler.add("c", record("c"), {a});
+  const auto bc = scheduler.milestone("bc", {b, c});
+  scheduler.add("d", record("d"), {bc});
+  scheduler.run();
+
+  ASSERT_EQ(4u, done.size());
+  EXPECT_EQ(0, index("a"));
+  EXPECT_EQ(3, index("d"));
+  EXPECT_ANY_THROW(scheduler.add("e", record("e"), {42}));
+}
+
+TEST(Scheduler, Pipelined) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::Scheduler scheduler(logger, 2);
+
+  // A dependent compiles against the interface of a library while it links
+  std::atomic<bool> linked {false}, compiledBeforeLink {false};
+  const auto interface = scheduler.milestone("lib interface");
+  const auto link = scheduler.addAsync("lib link", [&linked](brief::Scheduler::Done _done) {
+    std::thread([&linked, _done]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      linked = true;
+      _done(nullptr, {});
+    }).detach();
+  }, {interface});
+  const auto compile = scheduler.add("app compile", [&linked, &compiledBeforeLink]() {
+    compiledBeforeLink = !linked;
+  }, {interface});
+  std::atomic<bool> linkedAfterLib {false};
+  scheduler.add("app link", [&linked, &linkedAfterLib]() { linkedAfterLib = linked.load(); }, {compile, link});
+  scheduler.run();
+
+  EXPECT_TRUE(compiledBeforeLink);
+  EXPECT_TRUE(linkedAfterLib);
+}
+
+TEST(Scheduler, Failure) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::Scheduler scheduler(logger, 2);
+
+  std::atomic<int> running {0}, peak {0};
+  bool dependentRan = false;
+  std::vector<brief::Scheduler::id_t> actions;
+  for (int i = 0; i < 8; i++) {
+    actions.push_back(scheduler.add("sleep", [&running, &peak]() {
+      const int current = ++running;
+      for (int seen = peak; current > seen && !peak.compare_exchange_weak(seen, current);) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      running--;
+    }));
+  }
+  const auto failing = scheduler.add("failing", []() { throw std::runtime_error("expected"); }, actions);
+  scheduler.add("dependent", [&dependentRan]() { dependentRan = true; }, {failing});
+
+  EXPECT_THROW(scheduler.run(), std::runtime_error);
+  EXPECT_FALSE(dependentRan);
+  EXPECT_LE(peak, 2);
+  EXPECT_NE(std::string::npos, log.str().find("failing failed: expected"));
+}
+
+TEST(Scheduler, CriticalPath) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::BuildState state;
+  state.measure("short", std::chrono::milliseconds(1), 0);
+  state.measure("long", std::chrono::seconds(10), 0);
+  state.measure("after long", std::chrono::seconds(10), 0);
+
+  // With a single job, the longest path must start first even if added last
+  brief::Scheduler scheduler(logger, 1, &state);
+  std::vector<std::string> order;
+  scheduler.add("short", [&order]() { order.push_back("short"); });
+  scheduler.add("unknown", [&order]() {
+    order.push_back("unknown");
+    brief::Scheduler::report({42});
+  });
+  const auto longer = scheduler.add("long", [&order]() { order.push_back("long"); });
+  scheduler.add("after long", [&order]() {
+    order.push_back("after long");
+    brief::Scheduler::report({0, true});
+  }, {longer});
+  scheduler.run();
+
+  ASSERT_EQ(4u, order.size());
+  EXPECT_EQ("long", order[0]);
+  EXPECT_EQ("after long", order[1]);
+  EXPECT_EQ("unknown", order[2]);
+
+  // Measures are recorded, unless the action was up to date
+  EXPECT_EQ(42u, state.action("unknown").peakMemory_);
+  EXPECT_LT(state.action("long").duration_, 1000000u);
+  EXPECT_EQ(10000000u, state.action("after long").duration_);
+
+  // The build took its wall time, not the sum of the recorded durations
+  EXPECT_LT(0, state.lastDuration().count());
+  EXPECT_GT(std::chrono::seconds(1), state.lastDuration());
+}
+
+TEST(Scheduler, MemoryBudget) {
+  std::stringstream log;
+  brief::Logger logger(log, brief::Logger::W);
+  brief::Scheduler scheduler(logger, 4);
+  scheduler.setMemoryBudget(100);
+
+  // Heavy actions run one at a time, light ones run alongside
+  std::atomic<int> heavy {0}, heavyPeak {0}, lightDuringHeavy {0};
+  for (int i = 0; i < 3; i++) {
+    const auto id = scheduler.add("heavy", [&heavy, &heavyPeak]() {
+      const int current = ++heavy;
+      for (int seen = heavyPeak; current > seen && !heavyPeak.compare_exchange_weak(seen, current);) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      heavy--;
+    });
+    scheduler.classify(id, "link", 60);
+  }
+  for (int i = 0; i < 6; i++) {
+    scheduler.add("light", [&heavy, &lightDuringHeavy]() {
+      if (heavy > 0)
+        lightDuringHeavy++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    });
+  }
+  scheduler.run();
+
+  EXPECT_EQ(1, heavyPeak);
+  EXPECT_LT(0, lightDuringHeavy);
+}
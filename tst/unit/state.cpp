@@ -0,0 +1,106 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctime>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/state.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void write(const fs::path &_path, const std::string &_content, std::time_t _modified) {
+  std::ofstream(_path.string()) << _content;
+  fs::last_write_time(_path, _modified);
+}
+
+}  // namespace
+
+TEST(BuildState, EarlyCutoff) {
+  const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(dir);
+  const fs::path input = dir / "input", output = dir / "output";
+  const std::time_t past = std::time(nullptr) - 60;
+
+  brief::BuildState state;
+  write(input, "int a;", past);
+  const uint64_t inputs = state.hash(std::vector<fs::path> {input});
+  EXPECT_FALSE(state.upToDate("action", inputs, {output}));
+  write(output, "object", past);
+  EXPECT_TRUE(state.record("action", inputs, {output}));
+  EXPECT_TRUE(state.upToDate("action", inputs, {output}));
+
+  // Touching an input doesn't outdate the action, editing it does
+  write(input, "int a;", past + 10);
+  EXPECT_EQ(inputs, state.hash(std::vector<fs::path> {input}));
+  write(input, "int a; // Comment", past + 20);
+  const uint64_t edited = state.hash(std::vector<fs::path> {input});
+  EXPECT_NE(inputs, edited);
+  EXPECT_FALSE(state.upToDate("action", edited, {output}));
+
+  // Rebuilding an identical output is reported, so dependents can be skipped
+  write(output, "object", past + 20);
+  EXPECT_FALSE(state.record("action", edited, {output}));
+
+  // Outputs modified behind our back outdate the action
+  write(output, "tampered", past + 30);
+  EXPECT_FALSE(state.upToDate("action", edited, {output}));
+
+  const fs::path saved = dir / brief::BuildState::FILENAME;
+  state.record("action", edited, {output});
+  state.save(saved);
+  brief::BuildState loaded;
+  loaded.load(saved);
+  EXPECT_TRUE(loaded.upToDate("action", edited, {output}));
+  loaded.load(dir / "missing");
+  EXPECT_FALSE(loaded.upToDate("action", edited, {output}));
+
+  fs::remove_all(dir);
+}
+
+TEST(BuildState, Expiry) {
+  brief::BuildState state;
+  state.measure("deleted", std::chrono::seconds(1), 0);
+  state.measure("kept", std::chrono::seconds(1), 0);
+  state.finish({"deleted", "kept"}, std::chrono::seconds(3));
+  EXPECT_EQ(std::chrono::seconds(3), state.lastDuration());
+
+  // Actions are kept while other tasks are built, until they expire
+  for (uint64_t i = 1; i < brief::BuildState::EXPIRY; i++)
+    state.finish({"kept"}, std::chrono::seconds(2));
+  EXPECT_EQ(1000000u, state.action("deleted").duration_);
+  state.finish({"kept"}, std::chrono::seconds(2));
+  EXPECT_EQ(0u, state.action("deleted").duration_);
+  EXPECT_EQ(1000000u, state.action("kept").duration_);
+
+  const fs::path saved = fs::temp_directory_path() / fs::unique_path();
+  state.save(saved);
+  brief::BuildState loaded;
+  loaded.load(saved);
+  EXPECT_EQ(std::chrono::seconds(2), loaded.lastDuration());
+  EXPECT_EQ(1000000u, loaded.action("kept").duration_);
+  fs::remove(saved);
+}
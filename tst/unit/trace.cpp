@@ -0,0 +1,68 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/logger.hpp"
+#include "brief/scheduler.hpp"
+#include "brief/trace.hpp"
+
+namespace fs = boost::filesystem;
+
+TEST(Tracer, Scheduler) {
+  const fs::path path = fs::temp_directory_path() / fs::unique_path("brief-trace-%%%%-%%%%.json");
+  {
+    brief::Tracer disabled;
+    brief::Tracer::Span span(disabled, "test", "Ignored");
+    disabled.count("Ignored");
+  }
+  {
+    brief::Tracer tracer;
+    tracer.open(path);
+    tracer.nameThread("Main");
+    brief::Tracer::Span span(tracer, "test", "Schedule \"quoted\"");
+    span.arg("path", "a/b");
+
+    std::stringstream log;
+    brief::Logger logger(log, brief::Logger::W);
+    brief::Scheduler scheduler(logger, 2);
+    scheduler.setTracer(&tracer);
+    const auto first = scheduler.add("First", []() {});
+    scheduler.add("Second", []() { brief::Scheduler::report({0, true}); }, {first});
+    scheduler.run();
+  }
+
+  std::ifstream src(path.string());
+  const std::string trace((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  fs::remove(path);
+  EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"thread_name\",\"args\":{\"name\":\"Main\"}"));
+  EXPECT_NE(std::string::npos, trace.find("\"args\":{\"name\":\"Worker 1\"}"));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"Schedule \\\"quoted\\\"\",\"args\":{\"path\":\"a\\/b\"}"));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"First\",\"args\":{\"class\":\"\",\"cache\":\"miss\"}"));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"Second\",\"args\":{\"class\":\"\",\"cache\":\"hit\"}"));
+  EXPECT_NE(std::string::npos, trace.find("\"cat\":\"counter\",\"name\":\"Cache hits\",\"args\":{\"value\":1}"));
+  EXPECT_EQ(std::string::npos, trace.find("Ignored"));
+}
@@ -0,0 +1,163 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/context.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+brief::Dependency dependency(const std::string &_name, const std::string &_tag) {
+  brief::Dependency dep;
+  dep.name_ = _name;
+  dep.tag_ = _tag;
+  return dep;
+}
+
+brief::Repository repository(const std::string &_name) {
+  brief::Repository repo;
+  repo.name_ = _name;
+  brief::Task task;
+  task.toolchain_ = "clang";
+  task.sources_ = {"src/" + _name + ".cpp"};
+  repo.exports_.emplace(_name, task);
+  return repo;
+}
+
+}  // namespace
+
+TEST(Trunks, Index) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-trunks-%%%%-%%%%");
+  brief::Repository repo;
+  repo.name_ = "gtest";
+  brief::Task base, gtest, gmock;
+  base.toolchain_ = "clang";
+  base.sources_ = {"src/base.cpp"};
+  gtest.inherits_ = "base";
+  gtest.sources_ = {"src/gtest.cpp"};
+  gmock.toolchain_ = "gcc";
+  repo.tasks_.emplace("base", base);
+  repo.exports_.emplace("gtest", gtest);
+  repo.exports_.emplace("gmock", gmock);
+  {
+    brief::Context ctx(brief::Logger::W);
+    ctx.trunks_.setRoot(root);
+    EXPECT_FALSE(ctx.trunks_.has(dependency("gtest", "")));
+    EXPECT_TRUE(ctx.trunks_.list().empty());
+
+    ctx.trunks_.add(repo, "v1", root / "src" / "gtest.brief");
+    repo.exports_.find("gmock")->second.toolchain_ = "msvc";
+    ctx.trunks_.add(repo, "v2", root / "src" / "gtest.brief");
+    ctx.trunks_.add(repo, "v2", root / "src" / "gtest.brief");
+
+    // Enough tags to grow the index
+    for (int i = 0; i < 20; i++)
+      ctx.trunks_.add(repo, "r" + std::to_string(i), root / "src" / "gtest.brief");
+  }
+
+  brief::Context ctx(brief::Logger::W);
+  ctx.trunks_.setRoot(root);
+  EXPECT_TRUE(ctx.trunks_.has(dependency("gtest", "v1")));
+  EXPECT_TRUE(ctx.trunks_.has(dependency("gmock", "r19")));
+  EXPECT_FALSE(ctx.trunks_.has(dependency("gtest", "v3")));
+  EXPECT_FALSE(ctx.trunks_.has(dependency("base", "v1")));
+  EXPECT_THROW(ctx.trunks_.retreive(dependency("gtest", "")), std::runtime_error);
+
+  const brief::Task merged = ctx.trunks_.retreive(dependency("gtest", "v1"));
+  EXPECT_EQ("clang", merged.toolchain_);
+  EXPECT_EQ((std::vector<std::string> {"src/base.cpp", "src/gtest.cpp"}), merged.sources_);
+  EXPECT_TRUE(merged.inherits_.empty());
+  EXPECT_EQ("gcc", ctx.trunks_.retreive(dependency("gmock", "v1")).toolchain_);
+  EXPECT_EQ("msvc", ctx.trunks_.retreive(dependency("gmock", "v2")).toolchain_);
+
+  const std::vector<brief::installed_t> installed = ctx.trunks_.list();
+  ASSERT_EQ(44u, installed.size());
+  EXPECT_EQ("gmock", installed.front().export_);
+  EXPECT_EQ("gtest", installed.front().repo_);
+  EXPECT_EQ(root / "src" / "gtest.brief", installed.front().description_);
+
+  ctx.trunks_.remove("gtest", "v1");
+  EXPECT_FALSE(ctx.trunks_.has(dependency("gtest", "v1")));
+  EXPECT_TRUE(ctx.trunks_.has(dependency("gtest", "v2")));
+  EXPECT_EQ(42u, ctx.trunks_.list().size());
+  fs::remove_all(root);
+}
+
+TEST(Trunks, Compaction) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-trunks-%%%%-%%%%");
+  brief::Context ctx(brief::Logger::W);
+  ctx.trunks_.setRoot(root);
+  ctx.trunks_.add(repository("kept"), "v1", root / "kept.brief");
+  ctx.trunks_.add(repository("replaced"), "v1", root / "replaced.brief");
+  const uintmax_t installed = fs::file_size(root / brief::Trunks::PACK);
+
+  // Replaced records are dropped once they make up half of the pack
+  for (int i = 0; i < 20; i++) {
+    ctx.trunks_.add(repository("replaced"), "v1", root / "replaced.brief");
+    EXPECT_GE(2 * installed, fs::file_size(root / brief::Trunks::PACK));
+  }
+  ctx.trunks_.remove("replaced", "v1");
+  ctx.trunks_.add(repository("other"), "v1", root / "other.brief");
+  EXPECT_GE(2 * installed, fs::file_size(root / brief::Trunks::PACK));
+
+  brief::Context other(brief::Logger::W);
+  other.trunks_.setRoot(root);
+  EXPECT_EQ("src/kept.cpp", other.trunks_.retreive(dependency("kept", "v1")).sources_.front());
+  EXPECT_EQ("src/other.cpp", other.trunks_.retreive(dependency("other", "v1")).sources_.front());
+  EXPECT_FALSE(other.trunks_.has(dependency("replaced", "v1")));
+  fs::remove_all(root);
+}
+
+TEST(Trunks, ConcurrentWriters) {
+  const fs::path root = fs::temp_directory_path() / fs::unique_path("brief-trunks-%%%%-%%%%");
+
+  // Each Trunks locks the trunks through its own file description, as separate processes would
+  std::vector<std::thread> writers;
+  for (int w = 0; w < 4; w++) {
+    writers.emplace_back([&root, w]() {
+      brief::Context ctx(brief::Logger::W);
+      ctx.trunks_.setRoot(root);
+      for (int i = 0; i < 10; i++) {
+        const std::string name = "repo" + std::to_string(w) + "-" + std::to_string(i);
+        ctx.trunks_.add(repository(name), "v1", root / (name + ".brief"));
+        ctx.trunks_.add(repository(name), "v1", root / (name + ".brief"));
+      }
+    });
+  }
+  for (std::thread &writer : writers)
+    writer.join();
+
+  brief::Context ctx(brief::Logger::W);
+  ctx.trunks_.setRoot(root);
+  EXPECT_EQ(40u, ctx.trunks_.list().size());
+  for (int w = 0; w < 4; w++) {
+    for (int i = 0; i < 10; i++) {
+      const std::string name = "repo" + std::to_string(w) + "-" + std::to_string(i);
+      EXPECT_EQ("src/" + name + ".cpp", ctx.trunks_.retreive(dependency(name, "v1")).sources_.front()) << name;
+    }
+  }
+  fs::remove_all(root);
+}
@@ -0,0 +1,282 @@
+/*
+ * Brief: Hobby build system.
+ * Copyright (C) 2015 Jean-Baptiste "Jiboo" Lepesme
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctime>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "brief/model/task.hpp"
+#include "brief/toolchains/units.hpp"
+#include "brief/logger.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+/** Writes sources named by *_indices*, of varying sizes, and returns their units in glob order. */
+std::vector<brief::unit_t> makeUnits(const fs::path &_root, const std::vector<int> &_indices) {
+  std::vector<brief::unit_t> result;
+  for (int index : _indices) {
+    const std::string name = "source" + std::to_string(index) + ".cpp";
+    std::ofstream((_root / name).string()) << std::string(static_cast<size_t>(index % 7 + 1), ' ');
+    result.push_back({_root / name, _root / "obj" / (name + ".o"), _root / "obj" / (name + ".d")});
+  }
+  std::sort(result.begin(), result.end(), [](const brief::unit_t &_a, const brief::unit_t &_b) {
+    return _a.source_ < _b.source_;
+  });
+  return result;
+}
+
+std::vector<int> range(int _begin, int _end) {
+  std::vector<int> result;
+  for (int i = _begin; i < _end; i++)
+    result.push_back(i);
+  return result;
+}
+
+/** Batches as sets of source names, to compare two splits. */
+std::set<std::vector<std::string>> chunkNames(const std::vector<brief::unit_t> &_units, const brief::Task &_task,
+                                              const fs::path &_root) {
+  std::vector<const brief::unit_t*> units;
+  for (const brief::unit_t &unit : _units)
+    units.push_back(&unit);
+  std::set<std::vector<std::string>> result;
+  for (const auto &batch : brief::chunk(units, _task, _root)) {
+    std::vector<std::string> names;
+    for (const brief::unit_t *unit : batch)
+      names.push_back(unit->source_.filename().string());
+    result.insert(names);
+  }
+  return result;
+}
+
+/** Batches of *_a* that aren't in *_b*. */
+size_t missing(const std::set<std::vector<std::string>> &_a, const std::set<std::vector<std::string>> &_b) {
+  size_t result = 0;
+  for (const auto &batch : _a)
+    result += _b.count(batch) == 0;
+  return result;
+}
+
+class Units : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = fs::temp_directory_path() / fs::unique_path("brief-units-%%%%-%%%%");
+    fs::create_directories(root_);
+  }
+
+  void TearDown() override { fs::remove_all(root_); }
+
+  fs::path root_;
+};
+
+}  // namespace
+
+TEST_F(Units, ChunkCap) {
+  const std::vector<brief::unit_t> units = makeUnits(root_, range(0, 2000));
+  std::vector<const brief::unit_t*> pointers;
+  for (const brief::unit_t &unit : units)
+    pointers.push_back(&unit);
+
+  // Batches are cut at 4 times the target, at least one batch of these sources reaching it
+  brief::Task task;
+  task.unityBatch_ = 2;
+  size_t largest = 0, count = 0;
+  for (const auto &batch : brief::chunk(pointers, task, root_)) {
+    EXPECT_GE(8u, batch.size());
+    largest = std::max(largest, batch.size());
+    count += batch.size();
+  }
+  EXPECT_EQ(8u, largest);
+  EXPECT_EQ(units.size(), count);
+
+  // In bytes, a batch is cut on the source making it reach the cap
+  task.unityBatchBytes_ = 8;
+  bool capped = false;
+  for (const auto &batch : brief::chunk(pointers, task, root_)) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i + 1 < batch.size(); i++)
+      bytes += fs::file_size(batch[i]->source_);
+    EXPECT_GT(32u, bytes);
+    capped = capped || bytes + fs::file_size(batch.back()->source_) >= 32;
+  }
+  EXPECT_TRUE(capped);
+}
+
+TEST_F(Units, ChunkStability) {
+  brief::Task task;
+  task.unityBatch_ = 8;
+  const auto all = chunkNames(makeUnits(root_, range(0, 200)), task, root_);
+  EXPECT_LT(10u, all.size());
+
+  // Removing a source changes its batch, merged with the next one if the source ended it, other batches are kept
+  for (int removed : {0, 57, 123, 199}) {
+    std::vector<int> indices = range(0, 200);
+    indices.erase(indices.begin() + removed);
+    const auto split = chunkNames(makeUnits(root_, indices), task, root_);
+    EXPECT_LE(1u, missing(all, split)) << removed;
+    EXPECT_GE(2u, missing(all, split)) << removed;
+    EXPECT_GE(1u, missing(split, all)) << removed;
+  }
+
+  // Adding one changes the batch it joins, split in two if the new source ends it
+  for (int added : {200, 350, 999}) {
+    std::vector<int> indices = range(0, 200);
+    indices.push_back(added);
+    const auto split = chunkNames(makeUnits(root_, indices), task, root_);
+    EXPECT_GE(1u, missing(all, split)) << added;
+    EXPECT_LE(1u, missing(split, all)) << added;
+    EXPECT_GE(2u, missing(split, all)) << added;
+  }
+}
+
+TEST_F(Units, Batches) {
+  brief::Logger logger(std::cerr, brief::Logger::W);
+  brief::Task task;
+  task.unityBatch_ = 4;
+  const fs::path output = root_ / "build";
+  const std::vector<brief::unit_t> units = makeUnits(root_, range(0, 40));
+  const std::vector<brief::unit_t> first = brief::makeBatches(logger, units, task, root_, output);
+  ASSERT_LT(1u, first.size());
+  ASSERT_GT(units.size(), first.size());
+
+  // Batches include their members by absolute path
+  const brief::unit_t *batch = nullptr;
+  std::string content;
+  for (const brief::unit_t &unit : first) {
+    std::ifstream src(unit.source_.string());
+    content.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+    const bool generated = unit.source_.parent_path() == output / "unity";
+    if (generated && content.find(units[0].source_.string()) != std::string::npos) {
+      batch = &unit;
+      break;
+    }
+  }
+  ASSERT_NE(nullptr, batch);
+  EXPECT_NE(std::string::npos, content.find("#include \"" + units[0].source_.string() + "\"\n"));
+
+  // A source edited after its batch was built is compiled alone, other batches are kept
+  for (const brief::unit_t &unit : first)
+    std::ofstream(unit.object_.string());
+  const std::time_t built = fs::last_write_time(batch->object_);
+  for (const brief::unit_t &unit : units)
+    fs::last_write_time(unit.source_, built - 10);
+  fs::last_write_time(units[0].source_, built + 10);
+  const std::vector<brief::unit_t> second = brief::makeBatches(logger, units, task, root_, output);
+  size_t alone = 0, kept = 0;
+  for (const brief::unit_t &unit : second) {
+    alone += unit.source_ == units[0].source_;
+    kept += std::count_if(first.begin(), first.end(), [&unit](const brief::unit_t &_other) {
+      return _other.source_ == unit.source_;
+    });
+  }
+  EXPECT_EQ(1u, alone);
+  EXPECT_EQ(first.size(), kept);
+  std::ifstream src(batch->source_.string());
+  content.assign((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(std::string::npos, content.find(units[0].source_.string()));
+
+  // Batches no longer used are removed
+  const std::vector<brief::unit_t> remaining(units.begin() + 20, units.end());
+  const std::vector<brief::unit_t> third = brief::makeBatches(logger, remaining, task, root_, output);
+  std::set<fs::path> expected;
+  for (const brief::unit_t &unit : third) {
+    if (unit.source_.parent_path() == output / "unity")
+      expected.insert(unit.source_);
+  }
+  for (fs::directory_iterator file(output / "unity"), end; file != end; ++file) {
+    if (file->path().filename().string().compare(0, 6, "batch-") == 0) {
+      EXPECT_TRUE(expected.count(file->path()) || expected.count(fs::path(file->path()).replace_extension()))
+          << file->path();
+    }
+  }
+  EXPECT_FALSE(fs::exists(batch->source_));
+}
+
+TEST_F(Units, Prelude) {
+  std::ofstream((root_ / "common.h").string());
+  auto source = [this](const std::string &_name, const std::string &_content) {
+    std::ofstream((root_ / _name).string()) << _content;
+    return brief::unit_t {root_ / _name, root_ / (_name + ".o"), root_ / (_name + ".d")};
+  };
+  const std::vector<brief::unit_t> units {
+    source("a.cpp", "#include <vector>\n#include <string>\n#include <string>\n#if X\n#include <set>\n#endif\n"),
+    source("b.cpp", "  #  include <vector>\n#include \"common.h\"\n#include <set>\n"),
+    source("c.cpp", "#include \"common.h\"\n#include <map>\n#include <vector>\n"),
+    source("d.cpp", "#include <vector>\nint main() {}\n"),
+  };
+  std::vector<const brief::unit_t*> pointers;
+  for (const brief::unit_t &unit : units)
+    pointers.push_back(&unit);
+
+  // Headers included by at least half of the sources, in order, those in conditional blocks not counting
+  const std::string common = fs::canonical(root_ / "common.h").string();
+  EXPECT_EQ("#include <vector>\n#include \"" + common + "\"\n", brief::makePrelude(pointers));
+
+  // A header needs 2 sources, even if included by all of them
+  EXPECT_EQ("", brief::makePrelude({&units[0]}));
+  EXPECT_EQ("#include <vector>\n", brief::makePrelude({&units[0], &units[3]}));
+
+  // And half of them
+  std::vector<const brief::unit_t*> more = pointers;
+  more.push_back(&units[3]);
+  EXPECT_EQ("#include <vector>\n", brief::makePrelude(more));
+}
+
+TEST_F(Units, Precompiled) {
+  const fs::path dir = root_ / "pch";
+  const brief::unit_t pch {dir / "prelude.h", dir / "prelude.h.pch", dir / "prelude.h.d"};
+  const fs::path header = root_ / "a.h";
+  fs::create_directories(dir);
+  std::ofstream(header.string()) << "int a;\n";
+  std::ofstream(pch.depfile_.string()) << pch.object_.string() << ": " << pch.source_.string() << " \\\n  "
+                                       << header.string() << "\n";
+  const std::string prelude = "#include \"" + header.string() + "\"\n";
+  std::ofstream(pch.source_.string()) << prelude;
+  const std::vector<std::string> cc1 {"-cc1", "-O2"};
+
+  EXPECT_FALSE(brief::isPrecompiled(prelude, cc1, pch));
+  std::ofstream(pch.object_.string());
+  EXPECT_FALSE(brief::isPrecompiled(prelude, cc1, pch));
+  brief::recordPrecompiled(prelude, cc1, pch);
+  EXPECT_TRUE(brief::isPrecompiled(prelude, cc1, pch));
+
+  // Touching a header without changing it keeps the precompiled header
+  fs::last_write_time(header, fs::last_write_time(header) + 10);
+  EXPECT_TRUE(brief::isPrecompiled(prelude, cc1, pch));
+
+  // Changing the prelude, the command line or a header invalidates it
+  EXPECT_FALSE(brief::isPrecompiled(prelude + "#include <vector>\n", cc1, pch));
+  EXPECT_FALSE(brief::isPrecompiled(prelude, {"-cc1", "-O0"}, pch));
+  std::ofstream(header.string()) << "int b;\n";
+  EXPECT_FALSE(brief::isPrecompiled(prelude, cc1, pch));
+  brief::recordPrecompiled(prelude, cc1, pch);
+  EXPECT_TRUE(brief::isPrecompiled(prelude, cc1, pch));
+
+  // As does losing it
+  fs::remove(pch.object_);
+  EXPECT_FALSE(brief::isPrecompiled(prelude, cc1, pch));
+}